@@ -0,0 +1,485 @@
+/* bench_list.c -- micro benchmarks for list.c/.h
+**
+** Copyright (C) 2017 Olivier C. Larocque <oclarocque@protonmail.com>
+**
+** This software may be modified and distributed under the terms
+** of the MIT license. See the LICENSE file for details.
+*/
+
+/*
+** Includes
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "list.h"
+
+
+/*
+** Defines
+*/
+#define FIFO_COUNT   1000000
+#define FIFO_DEPTH   64
+#define FIFO_ROUNDS  20
+
+#define TRAVERSE_COUNT   1000000
+
+#define MEMORY_COUNT     ((1 << 20) + 1)
+#define TRAVERSE_ROUNDS  20
+
+#define CANCEL_COUNT     1000000
+
+#define PARALLEL_COUNT   4000000
+#define PARALLEL_ROUNDS  5
+#define PARALLEL_WORK    64
+
+#define FRAGMENT_COUNT   1000000
+#define SORT_COUNT       200000
+
+#define INSERT_THREADS   4
+#define INSERT_COUNT     1000
+#define INSERT_ROUNDS    2000
+
+
+/*
+** Local Function Declarations
+*/
+static double now(void);
+static void   report(const char *name, int ops, double secs);
+static double bench_fifo_fill_drain(list_t *l);
+static double bench_fifo_churn(list_t *l);
+static size_t heap_in_use(void);
+static void   bench_memory(const char *name, list_t *(*create)(void),
+                           int count);
+static double bench_traverse(list_t *l);
+static void   bench_cancel(const char *kind, bool lazy);
+static void  *work(void *val, void *ctx);
+static void  *combine(void *acc, void *val, void *ctx);
+static void   bench_parallel(const char *kind, list_t *l);
+static list_t *fragmented(int count);
+static void   bench_defragment(void);
+static void  *insert_worker(void *arg);
+static void   bench_insert(const char *name, const list_allocator_t *a);
+
+
+/*
+** Main
+*/
+int main(void)
+{
+    list_t *l;
+
+    printf("%-36s %12s %10s\n", "benchmark", "ops", "ns/op");
+
+    l = list_create();
+    report("fifo fill/drain (linked)", 2 * FIFO_COUNT, bench_fifo_fill_drain(l));
+    report("fifo churn (linked)", 2 * FIFO_ROUNDS * FIFO_COUNT, bench_fifo_churn(l));
+    list_destroy(l);
+
+    l = list_create_ring(0, false);
+    report("fifo fill/drain (ring)", 2 * FIFO_COUNT, bench_fifo_fill_drain(l));
+    report("fifo churn (ring)", 2 * FIFO_ROUNDS * FIFO_COUNT, bench_fifo_churn(l));
+    list_destroy(l);
+
+    l = list_create_ring(FIFO_DEPTH, true);
+    report("fifo churn (bounded ring)", 2 * FIFO_ROUNDS * FIFO_COUNT, bench_fifo_churn(l));
+    list_destroy(l);
+
+    printf("\n%-36s %12s %10s\n", "memory", "list bytes", "heap/elt");
+    bench_memory("linked", list_create, TRAVERSE_COUNT);
+    bench_memory("compact", list_create_compact, TRAVERSE_COUNT);
+    bench_memory("linked, 2^20 + 1", list_create, MEMORY_COUNT);
+    bench_memory("compact, 2^20 + 1", list_create_compact, MEMORY_COUNT);
+
+    printf("\n%-36s %12s %10s\n", "benchmark", "ops", "ns/op");
+
+    l = list_create();
+    report("traverse (linked)", TRAVERSE_ROUNDS * TRAVERSE_COUNT, bench_traverse(l));
+    list_destroy(l);
+
+    l = list_create_compact();
+    report("traverse (compact)", TRAVERSE_ROUNDS * TRAVERSE_COUNT, bench_traverse(l));
+    list_destroy(l);
+
+    bench_cancel("eager", false);
+    bench_cancel("lazy", true);
+
+    bench_defragment();
+
+    printf("\n%-36s %12s %10s\n", "threaded insert", "ops", "ns/op");
+    bench_insert("malloc allocator", &list_allocator_default);
+    bench_insert("thread local allocator", &list_allocator_thread_local);
+
+    bench_parallel("linked", list_create());
+    bench_parallel("compact", list_create_compact());
+
+    return 0;
+}
+
+
+/*
+** Local Function Definitions
+*/
+
+/*
+** now(): monotonic time in seconds
+*/
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+** report(): print one result line
+*/
+static void report(const char *name, int ops, double secs)
+{
+    printf("%-36s %12d %10.2f\n", name, ops, secs * 1e9 / ops);
+}
+
+/*
+** bench_fifo_fill_drain(): enqueue FIFO_COUNT values then dequeue them all
+*/
+static double bench_fifo_fill_drain(list_t *l)
+{
+    double start = now();
+    void *val;
+    intptr_t i;
+
+    for (i = 0; i < FIFO_COUNT; i++) {
+        list_add_last(l, (void *)i);
+    }
+    while (list_pop_first(l, &val) == LIST_OK) {
+    }
+
+    return now() - start;
+}
+
+/*
+** bench_fifo_churn(): keep FIFO_DEPTH values queued while pushing and
+**                     popping one value at a time
+*/
+static double bench_fifo_churn(list_t *l)
+{
+    double start = now();
+    void *val;
+    intptr_t i;
+    int r;
+
+    for (r = 0; r < FIFO_ROUNDS; r++) {
+        for (i = 0; i < FIFO_DEPTH; i++) {
+            list_add_last(l, (void *)i);
+        }
+        for (i = 0; i < FIFO_COUNT; i++) {
+            list_pop_first(l, &val);
+            list_add_last(l, (void *)i);
+        }
+        list_clear(l);
+    }
+
+    return now() - start;
+}
+
+/*
+** heap_in_use(): bytes currently handed out by the allocator, headers and
+**                mmap()ed blocks included (0 when the C library cannot tell)
+*/
+static size_t heap_in_use(void)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 mi = mallinfo2();
+
+    return mi.uordblks + mi.hblkhd;
+#elif defined(__GLIBC__)
+    struct mallinfo mi = mallinfo();
+
+    return (unsigned int)mi.uordblks + (unsigned int)mi.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+/*
+** bench_memory(): report list_memory_usage() and the heap actually consumed
+**                 per element for count elements
+*/
+static void bench_memory(const char *name, list_t *(*create)(void), int count)
+{
+    size_t before = heap_in_use();
+    list_t *l = create();
+    intptr_t i;
+
+    for (i = 0; i < count; i++) {
+        list_add_last(l, (void *)i);
+    }
+
+    printf("%-36s %12zu %10.2f\n", name, list_memory_usage(l),
+           (double)(heap_in_use() - before) / count);
+
+    list_destroy(l);
+}
+
+/*
+** bench_traverse(): walk the whole list looking for a missing value
+*/
+static double bench_traverse(list_t *l)
+{
+    double start;
+    intptr_t i;
+    int r;
+
+    for (i = 0; i < TRAVERSE_COUNT; i++) {
+        list_add_last(l, (void *)i);
+    }
+
+    start = now();
+    for (r = 0; r < TRAVERSE_ROUNDS; r++) {
+        list_find(l, (void *)(intptr_t)-1);
+    }
+
+    return now() - start;
+}
+
+/*
+** bench_cancel(): remove every other element through its handle, then time
+**                 the compaction on its own (a no-op unless lazy)
+*/
+static void bench_cancel(const char *kind, bool lazy)
+{
+    element_t **handles = malloc(CANCEL_COUNT * sizeof(element_t *));
+    list_t *l = list_create();
+    char name[64];
+    double start;
+    intptr_t i;
+
+    list_set_lazy(l, lazy, 0);
+
+    for (i = 0; i < CANCEL_COUNT; i++) {
+        list_add_last_element(l, (void *)i, &handles[i]);
+    }
+
+    start = now();
+    for (i = 0; i < CANCEL_COUNT; i += 2) {
+        list_remove_element(l, handles[i]);
+    }
+    snprintf(name, sizeof(name), "cancel by handle (%s)", kind);
+    report(name, CANCEL_COUNT / 2, now() - start);
+
+    if (lazy) {
+        start = now();
+        list_compact(l);
+        snprintf(name, sizeof(name), "compact (%s)", kind);
+        report(name, CANCEL_COUNT / 2, now() - start);
+    }
+
+    free(handles);
+    list_destroy(l);
+}
+
+/*
+** work(): a map callback doing PARALLEL_WORK rounds of integer hashing
+*/
+static void *work(void *val, void *ctx)
+{
+    uintptr_t x = (uintptr_t)val;
+    int i;
+
+    for (i = 0; i < PARALLEL_WORK; i++) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+
+    return (void *)(x >> 40);
+}
+
+/*
+** combine(): an associative reduce callback
+*/
+static void *combine(void *acc, void *val, void *ctx)
+{
+    return (void *)((uintptr_t)acc + (uintptr_t)val);
+}
+
+/*
+** bench_parallel(): time list_map() and list_reduce() for 1, 2, 4, ... up to
+**                   the number of online CPUs; consumes l
+*/
+static void bench_parallel(const char *kind, list_t *l)
+{
+    char name[64];
+    double start;
+    intptr_t i;
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int threads;
+    int r;
+
+    for (i = 0; i < PARALLEL_COUNT; i++) {
+        list_add_last(l, (void *)i);
+    }
+
+    printf("\n%-36s %12s %10s\n", kind, "ops", "ns/op");
+
+    for (threads = 1; threads <= cpus; threads *= 2) {
+        list_set_threads(l, threads);
+
+        start = now();
+        list_reduce(l, combine, 0, NULL);
+        snprintf(name, sizeof(name), "reduce, first call (%d thr)", threads);
+        report(name, PARALLEL_COUNT, now() - start);
+
+        start = now();
+        for (r = 0; r < PARALLEL_ROUNDS; r++) {
+            list_reduce(l, combine, 0, NULL);
+        }
+        snprintf(name, sizeof(name), "reduce (%d thr)", threads);
+        report(name, PARALLEL_ROUNDS * PARALLEL_COUNT, now() - start);
+
+        start = now();
+        for (r = 0; r < PARALLEL_ROUNDS; r++) {
+            list_map(l, work, NULL);
+        }
+        snprintf(name, sizeof(name), "map (%d thr)", threads);
+        report(name, PARALLEL_ROUNDS * PARALLEL_COUNT, now() - start);
+    }
+
+    list_destroy(l);
+}
+
+/*
+** fragmented(): build a linked list whose consecutive elements are scattered
+**               across the heap, by first freeing element sized blocks in
+**               random order so that the allocator hands them out shuffled
+*/
+static list_t *fragmented(int count)
+{
+    void **blocks = malloc(count * sizeof(void *));
+    list_t *l = list_create();
+    void *tmp;
+    int i;
+    int j;
+
+    srand(42);
+
+    for (i = 0; i < count; i++) {
+        blocks[i] = malloc(sizeof(element_t));
+    }
+    for (i = count - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        tmp = blocks[i];
+        blocks[i] = blocks[j];
+        blocks[j] = tmp;
+    }
+    for (i = 0; i < count; i++) {
+        free(blocks[i]);
+    }
+    free(blocks);
+
+    for (i = 0; i < count; i++) {
+        list_add_last(l, (void *)(intptr_t)(rand() % count));
+    }
+
+    return l;
+}
+
+/*
+** bench_defragment(): traverse and sort a fragmented list, then the same
+**                     list after list_defragment()
+*/
+static void bench_defragment(void)
+{
+    list_t *l;
+    double start;
+    int r;
+
+    printf("\n%-36s %12s %10s\n", "fragmented heap", "ops", "ns/op");
+
+    l = fragmented(FRAGMENT_COUNT);
+
+    start = now();
+    for (r = 0; r < TRAVERSE_ROUNDS; r++) {
+        list_find(l, (void *)(intptr_t)-1);
+    }
+    report("traverse (fragmented)", TRAVERSE_ROUNDS * FRAGMENT_COUNT, now() - start);
+
+    start = now();
+    list_defragment(l);
+    report("list_defragment", FRAGMENT_COUNT, now() - start);
+
+    start = now();
+    for (r = 0; r < TRAVERSE_ROUNDS; r++) {
+        list_find(l, (void *)(intptr_t)-1);
+    }
+    report("traverse (defragmented)", TRAVERSE_ROUNDS * FRAGMENT_COUNT, now() - start);
+
+    list_destroy(l);
+
+    l = fragmented(SORT_COUNT);
+
+    start = now();
+    list_sort(l);
+    report("sort (fragmented)", SORT_COUNT, now() - start);
+
+    list_destroy(l);
+
+    l = fragmented(SORT_COUNT);
+    list_defragment(l);
+
+    start = now();
+    list_sort(l);
+    report("sort (defragmented)", SORT_COUNT, now() - start);
+
+    list_destroy(l);
+}
+
+/*
+** insert_worker(): producer thread filling and draining its own list
+*/
+static void *insert_worker(void *arg)
+{
+    list_t *l = list_create_with_allocator((const list_allocator_t *)arg);
+    intptr_t i;
+    int r;
+
+    for (r = 0; r < INSERT_ROUNDS; r++) {
+        for (i = 0; i < INSERT_COUNT; i++) {
+            list_add_last(l, (void *)i);
+        }
+        while (list_is_not_empty(l)) {
+            list_remove_pos(l, 0);
+        }
+    }
+
+    list_destroy(l);
+
+    return NULL;
+}
+
+/*
+** bench_insert(): run INSERT_THREADS producers concurrently with the given
+**                 allocator; ns/op is wall time per add/remove pair
+*/
+static void bench_insert(const char *name, const list_allocator_t *a)
+{
+    pthread_t threads[INSERT_THREADS];
+    double start = now();
+    int k;
+
+    for (k = 0; k < INSERT_THREADS; k++) {
+        pthread_create(&threads[k], NULL, insert_worker, (void *)a);
+    }
+    for (k = 0; k < INSERT_THREADS; k++) {
+        pthread_join(threads[k], NULL);
+    }
+
+    report(name, INSERT_THREADS * INSERT_ROUNDS * INSERT_COUNT, now() - start);
+}
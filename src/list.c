@@ -9,15 +9,169 @@
 /*
 ** Includes
 */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef LIST_USE_NUMA
+#include <numa.h>
+#endif
 #include "list.h"
 
 
+/*
+** Defines
+*/
+#if defined(__GNUC__)
+#define LIST_PREFETCH(p)  __builtin_prefetch(p)
+#else
+#define LIST_PREFETCH(p)  ((void)(p))
+#endif
+
+#define LIST_PREFETCH_DISTANCE  8
+
+
+/*
+** Type Declarations
+*/
+typedef enum parallel_op {
+    OP_FOREACH,
+    OP_MAP,
+    OP_FILTER,
+    OP_REDUCE
+} parallel_op_t;
+
+typedef struct cursor {
+    element_t *e;
+    uint32_t   i;
+    int        pos;
+} cursor_t;
+
+typedef struct job {
+    list_t        *l;
+    parallel_op_t  op;
+    void         (*each)(void *val, void *ctx);
+    void        *(*map)(void *val, void *ctx);
+    bool         (*pred)(void *val, void *ctx);
+    void        *(*reduce)(void *acc, void *val, void *ctx);
+    void          *init;
+    void          *ctx;
+    struct task   *tasks;
+    int            ntasks;
+    int            next;
+    int            pending;
+    struct job    *queued;
+} job_t;
+
+typedef struct task {
+    job_t     *job;
+    cursor_t   begin;
+    int        end;
+    bool       failed;
+    void      *acc;
+    void     **kept;
+    int        nkept;
+} task_t;
+
+typedef struct tl_cache {
+    void *head;
+    int   count;
+    bool  registered;
+} tl_cache_t;
+
+
 /*
 ** Local Function Declarations
 */
+static void *default_alloc(size_t size, void *ctx);
+static void  default_free(void *ptr, size_t size, void *ctx);
+static void *tl_alloc(size_t size, void *ctx);
+static void  tl_free(void *ptr, size_t size, void *ctx);
+static void  tl_drain(void *arg);
+static void  tl_init(void);
+#ifdef LIST_USE_NUMA
+static void *numa_local_alloc(size_t size, void *ctx);
+static void  numa_local_free(void *ptr, size_t size, void *ctx);
+#endif
+static void *mem_alloc(list_t *l, size_t size);
+static void  mem_free(list_t *l, void *ptr, size_t size);
+static bool  alloc_storage(list_t *l);
+static void  free_storage(list_t *l);
+static int   compare_values(const void *a, const void *b);
+static int   compare_elements(const void *a, const void *b);
+static element_t *alloc_element(list_t *l);
+static int  linked_add_last(list_t *l, void *val, element_t **e);
+static int  linked_add_first(list_t *l, void *val, element_t **e);
 static void remove_element(list_t *l, element_t *e);
+static void kill_element(list_t *l, element_t *e);
+static void       set_prev(element_t *e, element_t *prev);
+static bool       is_dead(const element_t *e);
+static bool       is_pooled(const element_t *e);
+static void       prefetch_element(list_t *l, element_t *e);
+static void       prefetch_node(list_t *l, uint32_t i);
+static element_t *skip_dead(element_t *e);
+static element_t *skip_dead_prev(element_t *e);
+static int  ring_index(list_t *l, int pos);
+static int  ring_grow(list_t *l);
+static int  ring_add_last(list_t *l, void *val);
+static int  ring_add_first(list_t *l, void *val);
+static int  ring_remove_pos(list_t *l, int pos);
+static cnode_t *pool_node(list_t *l, uint32_t i);
+static bool     pool_init(list_t *l, pool_t *p, uint32_t capacity);
+static int      pool_grow(list_t *l, pool_t *p);
+static void     pool_release(list_t *l, pool_t *p);
+static int      pool_alloc(list_t *l, void *val, uint32_t *i);
+static int      pool_add_last(list_t *l, void *val);
+static int      pool_add_first(list_t *l, void *val);
+static void     pool_remove(list_t *l, uint32_t i);
+static uint32_t pool_find(list_t *l, void *val);
+static uint32_t pool_find_pos(list_t *l, int pos);
+static void   cursor_begin(list_t *l, cursor_t *c);
+static void   cursor_next(list_t *l, cursor_t *c);
+static void **cursor_slot(list_t *l, cursor_t *c);
+static int    parallel_parts(list_t *l);
+static void   parallel_parts_add_last(list_t *l);
+static void   parallel_parts_add_first(list_t *l);
+static void  *parallel_task(void *arg);
+static task_t *parallel_take(job_t *job);
+static void  *parallel_worker(void *arg);
+static task_t *parallel_run(job_t *job, int *count, task_t *serial);
+static void   parallel_free(list_t *l, task_t *tasks, int n, task_t *serial);
+static size_t parallel_kept_size(const task_t *t);
+
+
+/*
+** Global Data
+*/
+const list_allocator_t list_allocator_default = {
+    default_alloc, default_free, NULL
+};
+
+const list_allocator_t list_allocator_thread_local = {
+    tl_alloc, tl_free, NULL
+};
+
+#ifdef LIST_USE_NUMA
+const list_allocator_t list_allocator_numa_local = {
+    numa_local_alloc, numa_local_free, NULL
+};
+#endif
+
+
+/*
+** Local Data
+*/
+static _Thread_local tl_cache_t tl_cache;
+static pthread_key_t  tl_key;
+static pthread_once_t tl_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  pool_done = PTHREAD_COND_INITIALIZER;
+static job_t          *pool_jobs;
+static int             pool_workers;
 
 
 /*
@@ -27,15 +181,151 @@ static void remove_element(list_t *l, element_t *e);
 /*
 ** list_create(): create a list dynamically
 ** in  <- none
-** out -> new list
+** out -> new list, NULL if out of memory
 */
 list_t *list_create(void)
 {
-    list_t *l = (list_t *)malloc(sizeof(list_t));
+    return list_create_with_allocator(&list_allocator_default);
+}
+
+/*
+** list_create_ring(): create a list backed by a contiguous ring buffer
+** in  <- capacity: initial number of slots (LIST_RING_DEFAULT_CAPACITY if <= 0)
+**     <- bounded:  if true, the buffer never grows and adds fail when full
+** out -> new list, NULL if out of memory
+*/
+list_t *list_create_ring(int capacity, bool bounded)
+{
+    return list_create_ring_with_allocator(capacity, bounded,
+                                           &list_allocator_default);
+}
+
+/*
+** list_create_compact(): create a list whose nodes live in a single pool and
+**                        are linked by 32-bit pool indices instead of pointers
+** in  <- none
+** out -> new list, NULL if out of memory
+*/
+list_t *list_create_compact(void)
+{
+    return list_create_compact_with_allocator(&list_allocator_default);
+}
+
+/*
+** list_create_with_allocator(): create a list whose header, elements and
+**                               buffers all come from an allocator
+** in  <- a: allocator, copied into the list
+** out -> new list, NULL if out of memory
+*/
+list_t *list_create_with_allocator(const list_allocator_t *a)
+{
+    list_t *l = (list_t *)a->alloc(sizeof(list_t), a->ctx);
+
+    if (l == NULL) {
+        return NULL;
+    }
 
     l->size  = 0;
     l->head  = NULL;
     l->tail  = NULL;
+    l->type  = LIST_LINKED;
+
+    l->lazy           = false;
+    l->dead           = 0;
+    l->dead_threshold = 0;
+    l->graveyard      = NULL;
+
+    l->threads  = 0;
+    l->nparts   = 0;
+    l->maxparts = 0;
+    l->parts    = NULL;
+
+    if (pthread_mutex_init(&l->lock, NULL)) {
+        a->free(l, sizeof(list_t), a->ctx);
+        return NULL;
+    }
+
+    l->alloc = *a;
+    l->owner = *a;
+
+    l->slab.nodes = NULL;
+    l->slab.size  = 0;
+    l->slab.used  = 0;
+    l->slab.free  = NULL;
+
+    l->ring.buf      = NULL;
+    l->ring.capacity = 0;
+    l->ring.start    = 0;
+    l->ring.bounded  = false;
+
+    l->pool.blocks    = NULL;
+    l->pool.nblocks   = 0;
+    l->pool.maxblocks = 0;
+    l->pool.capacity  = 0;
+    l->pool.used     = 0;
+    l->pool.free     = LIST_NIL;
+    l->pool.head     = LIST_NIL;
+    l->pool.tail     = LIST_NIL;
+    l->pool.ordered  = true;
+
+    return l;
+}
+
+/*
+** list_create_ring_with_allocator(): list_create_ring() through an allocator
+** in  <- capacity: initial number of slots (LIST_RING_DEFAULT_CAPACITY if <= 0)
+**     <- bounded:  if true, the buffer never grows and adds fail when full
+**     <- a:        allocator, copied into the list
+** out -> new list, NULL if out of memory
+*/
+list_t *list_create_ring_with_allocator(int capacity, bool bounded,
+                                        const list_allocator_t *a)
+{
+    list_t *l = list_create_with_allocator(a);
+
+    if (l == NULL) {
+        return NULL;
+    }
+
+    if (capacity <= 0) {
+        capacity = LIST_RING_DEFAULT_CAPACITY;
+    }
+
+    l->type = LIST_RING;
+
+    l->ring.capacity = capacity;
+    l->ring.bounded  = bounded;
+
+    if (!alloc_storage(l)) {
+        list_destroy(l);
+        return NULL;
+    }
+
+    return l;
+}
+
+/*
+** list_create_compact_with_allocator(): list_create_compact() through an
+**                                       allocator
+** in  <- a: allocator, copied into the list
+** out -> new list, NULL if out of memory
+*/
+list_t *list_create_compact_with_allocator(const list_allocator_t *a)
+{
+    list_t *l = list_create_with_allocator(a);
+
+    if (l == NULL) {
+        return NULL;
+    }
+
+    l->type = LIST_COMPACT;
+
+    l->pool.capacity = LIST_POOL_DEFAULT_CAPACITY;
+
+    if (!alloc_storage(l)) {
+        list_destroy(l);
+        return NULL;
+    }
 
     return l;
 }
@@ -47,11 +337,13 @@ list_t *list_create(void)
 */
 void list_destroy(list_t *l)
 {
-    while (l->size) {
-        remove_element(l, l->tail);
-    }
+    list_allocator_t owner = l->owner;
 
-    free(l);
+    list_clear(l);
+    free_storage(l);
+    pthread_mutex_destroy(&l->lock);
+
+    owner.free(l, sizeof(list_t), owner.ctx);
 }
 
 /*
@@ -61,9 +353,29 @@ void list_destroy(list_t *l)
 */
 void list_clear(list_t *l)
 {
-    while (l->size) {
+    l->nparts = 0;
+
+    if (l->type == LIST_RING) {
+        l->size       = 0;
+        l->ring.start = 0;
+        return;
+    }
+
+    if (l->type == LIST_COMPACT) {
+        l->size         = 0;
+        l->pool.used    = 0;
+        l->pool.free    = LIST_NIL;
+        l->pool.head    = LIST_NIL;
+        l->pool.tail    = LIST_NIL;
+        l->pool.ordered = true;
+        return;
+    }
+
+    while (l->tail != NULL) {
         remove_element(l, l->tail);
     }
+
+    l->graveyard = NULL;
 }
 
 /*
@@ -74,12 +386,107 @@ void list_clear(list_t *l)
 void list_print(list_t *l)
 {
     element_t *e = l->head;
+    uint32_t i;
     int pos = 0;
 
+    if (l->type == LIST_RING) {
+        for (pos = 0; pos < l->size; pos++) {
+            printf("Element %d has value %d\n", pos,
+                   (int)(intptr_t)l->ring.buf[ring_index(l, pos)]);
+        }
+        return;
+    }
+
+    if (l->type == LIST_COMPACT) {
+        for (i = l->pool.head; i != LIST_NIL; i = pool_node(l, i)->next) {
+            printf("Element %d has value %d\n", pos++,
+                   (int)(intptr_t)pool_node(l, i)->val);
+        }
+        return;
+    }
+
+    e = skip_dead(e);
     while (e != NULL) {
         printf("Element %d has value %d\n", pos++, e->val);
-        e = e->next;
+        e = skip_dead(e->next);
+    }
+}
+
+/*
+** list_set_allocator(): make an empty list allocate its elements and buffers
+**                       through another allocator
+** in  <- l: empty list
+**     <- a: allocator, copied into the list
+** out -> LIST_OK, LIST_ERR_NOT_EMPTY or LIST_ERR_NOMEM (in which case the
+**        list keeps its previous allocator and buffers)
+*/
+int list_set_allocator(list_t *l, const list_allocator_t *a)
+{
+    list_t old;
+
+    if (l->size || l->dead) {
+        return LIST_ERR_NOT_EMPTY;
+    }
+
+    list_clear(l);
+    old = *l;
+
+    l->alloc = *a;
+    if (!alloc_storage(l)) {
+        l->alloc = old.alloc;
+        l->ring  = old.ring;
+        l->pool  = old.pool;
+        return LIST_ERR_NOMEM;
+    }
+
+    /* release the old buffers through the old allocator, then take over
+    ** the emptied slab and chunk cache */
+    free_storage(&old);
+    l->slab     = old.slab;
+    l->parts    = old.parts;
+    l->nparts   = old.nparts;
+    l->maxparts = old.maxparts;
+
+    return LIST_OK;
+}
+
+/*
+** list_thread_cache_flush(): release the elements cached for the calling
+**                            thread by list_allocator_thread_local; done
+**                            automatically when the thread exits
+** in  <- none
+** out -> none
+*/
+void list_thread_cache_flush(void)
+{
+    tl_drain(&tl_cache);
+}
+
+/*
+** list_memory_usage(): number of bytes requested from the allocator to hold
+**                      the list and its elements (allocator headers excluded)
+** in  <- l: list
+** out -> bytes
+*/
+size_t list_memory_usage(list_t *l)
+{
+    size_t bytes = sizeof(list_t);
+
+    switch (l->type) {
+    case LIST_RING:
+        bytes += l->ring.capacity * sizeof(void *);
+        break;
+    case LIST_COMPACT:
+        bytes += l->pool.capacity * sizeof(cnode_t) +
+                 l->pool.maxblocks * sizeof(cnode_t *);
+        break;
+    default:
+        bytes += (l->size + l->dead - l->slab.used + l->slab.size) *
+                 sizeof(element_t);
+        break;
     }
+
+    return bytes;
 }
 
 /*
@@ -102,24 +509,149 @@ bool list_is_not_empty(list_t *l)
     return !!l->size;
 }
 
+/*
+** list_is_full(): check if a bounded ring list has no free slot left
+** in  <- l: list
+** out -> true if full, false otherwise (always false for unbounded lists)
+*/
+bool list_is_full(list_t *l)
+{
+    return (l->type == LIST_RING) && l->ring.bounded &&
+           (l->size == l->ring.capacity);
+}
+
 /*
 ** list_first(): return the first element value
 ** in  <- l: list
-** out -> value
+** out -> value, -1 if the list is empty (see list_peek_first())
 */
 int list_first(list_t* l)
 {
-    return l->head->val;
+    void *val = (void *)(intptr_t)-1;
+
+    list_peek_first(l, &val);
+
+    return (int)(intptr_t)val;
 }
 
 /*
 ** list_last(): return the last element value
 ** in  <- l: list
-** out -> value
+** out -> value, -1 if the list is empty (see list_peek_last())
 */
 int list_last(list_t* l)
 {
-    return l->tail->val;
+    void *val = (void *)(intptr_t)-1;
+
+    list_peek_last(l, &val);
+
+    return (int)(intptr_t)val;
+}
+
+/*
+** list_peek_first(): read the first value without removing it
+** in  <- l:   list
+**     -> val: first value, untouched if the list is empty
+** out -> LIST_OK, LIST_ERR_EMPTY
+*/
+int list_peek_first(list_t *l, void **val)
+{
+    if (!l->size) {
+        return LIST_ERR_EMPTY;
+    }
+
+    if (l->type == LIST_RING) {
+        *val = l->ring.buf[l->ring.start];
+    } else if (l->type == LIST_COMPACT) {
+        *val = pool_node(l, l->pool.head)->val;
+    } else {
+        *val = skip_dead(l->head)->val;
+    }
+
+    return LIST_OK;
+}
+
+/*
+** list_peek_last(): read the last value without removing it
+** in  <- l:   list
+**     -> val: last value, untouched if the list is empty
+** out -> LIST_OK, LIST_ERR_EMPTY
+*/
+int list_peek_last(list_t *l, void **val)
+{
+    if (!l->size) {
+        return LIST_ERR_EMPTY;
+    }
+
+    if (l->type == LIST_RING) {
+        *val = l->ring.buf[ring_index(l, l->size - 1)];
+    } else if (l->type == LIST_COMPACT) {
+        *val = pool_node(l, l->pool.tail)->val;
+    } else {
+        *val = skip_dead_prev(l->tail)->val;
+    }
+
+    return LIST_OK;
+}
+
+/*
+** list_pop_first(): remove the first value and hand it to the caller
+** in  <- l:   list
+**     -> val: removed value, untouched if the list is empty
+** out -> LIST_OK, LIST_ERR_EMPTY
+*/
+int list_pop_first(list_t *l, void **val)
+{
+    int err = list_peek_first(l, val);
+
+    if (err != LIST_OK) {
+        return err;
+    }
+
+    l->nparts = 0;
+
+    if (l->type == LIST_RING) {
+        return ring_remove_pos(l, 0);
+    }
+
+    if (l->type == LIST_COMPACT) {
+        pool_remove(l, l->pool.head);
+        return LIST_OK;
+    }
+
+    kill_element(l, skip_dead(l->head));
+
+    return LIST_OK;
+}
+
+/*
+** list_pop_last(): remove the last value and hand it to the caller
+** in  <- l:   list
+**     -> val: removed value, untouched if the list is empty
+** out -> LIST_OK, LIST_ERR_EMPTY
+*/
+int list_pop_last(list_t *l, void **val)
+{
+    int err = list_peek_last(l, val);
+
+    if (err != LIST_OK) {
+        return err;
+    }
+
+    l->nparts = 0;
+
+    if (l->type == LIST_RING) {
+        return ring_remove_pos(l, l->size - 1);
+    }
+
+    if (l->type == LIST_COMPACT) {
+        pool_remove(l, l->pool.tail);
+        return LIST_OK;
+    }
+
+    kill_element(l, skip_dead_prev(l->tail));
+
+    return LIST_OK;
 }
 
 /*
@@ -131,13 +663,36 @@ int list_last(list_t* l)
 int list_find(list_t *l, void *val)
 {
     element_t *e = l->head;
+    uint32_t i;
     int pos = 0;
 
+    if (l->type == LIST_RING) {
+        for (pos = 0; pos < l->size; pos++) {
+            if (l->ring.buf[ring_index(l, pos)] == val) {
+                return pos;
+            }
+        }
+        return (-1);
+    }
+
+    if (l->type == LIST_COMPACT) {
+        for (i = l->pool.head; i != LIST_NIL; i = pool_node(l, i)->next) {
+            prefetch_node(l, i);
+            if (pool_node(l, i)->val == val) {
+                return pos;
+            }
+            pos++;
+        }
+        return (-1);
+    }
+
+    e = skip_dead(e);
     while (e != NULL) {
+        prefetch_element(l, e);
         if (e->val == val) {
             return pos;
         }
-        e = e->next;
+        e = skip_dead(e->next);
         pos++;
     }
 
@@ -153,13 +708,31 @@ int list_find(list_t *l, void *val)
 int list_find_pos(list_t *l, int pos)
 {
     element_t *e = l->head;
+    uint32_t n;
     int i = 0;
 
+    if (l->type == LIST_RING) {
+        if ((pos < 0) || (pos >= l->size)) {
+            return (-1);
+        }
+        return (int)(intptr_t)l->ring.buf[ring_index(l, pos)];
+    }
+
+    if (l->type == LIST_COMPACT) {
+        n = pool_find_pos(l, pos);
+        if (n == LIST_NIL) {
+            return (-1);
+        }
+        return (int)(intptr_t)pool_node(l, n)->val;
+    }
+
+    e = skip_dead(e);
     while (e != NULL) {
+        prefetch_element(l, e);
         if (i == pos) {
             return e->val;
         }
-        e = e->next;
+        e = skip_dead(e->next);
         i++;
     }
 
@@ -170,133 +743,320 @@ int list_find_pos(list_t *l, int pos)
 ** list_add_last(): add an element to the list at the last position
 ** in  <- l:   list
 **     <- val: value of the element to add
-** out -> none
+** out -> LIST_OK, LIST_ERR_FULL if a bounded ring list is full,
+**        LIST_ERR_NOMEM if out of memory
 */
-void list_add_last(list_t *l, void *val)
+int list_add_last(list_t *l, void *val)
 {
-    element_t *new_tail = (element_t *)malloc(sizeof(element_t));
-    element_t *old_tail = l->tail;
+    return list_add_last_element(l, val, NULL);
+}
 
-    new_tail->val  = val;
-    new_tail->next = NULL;
-    new_tail->prev = old_tail;
+/*
+** list_add_first(): add an element to the list at the first position
+** in  <- l:   list
+**     <- val: value of the element to add
+** out -> LIST_OK, LIST_ERR_FULL if a bounded ring list is full,
+**        LIST_ERR_NOMEM if out of memory
+*/
+int list_add_first(list_t *l, void *val)
+{
+    return list_add_first_element(l, val, NULL);
+}
 
-    if (old_tail != NULL) {
-        old_tail->next = new_tail;
-    }
+/*
+** list_add_last_element(): add an element at the last position and hand
+**                          back its node, for list_remove_element()
+** in  <- l:   list
+**     <- val: value of the element to add
+**     <- e:   where to store the new element (NULL on ring and compact
+**             lists, whose values have no node), or NULL
+** out -> LIST_OK, LIST_ERR_FULL if a bounded ring list is full,
+**        LIST_ERR_NOMEM if out of memory
+*/
+int list_add_last_element(list_t *l, void *val, element_t **e)
+{
+    element_t *new_tail = NULL;
+    int err;
 
-    l->tail = new_tail;
+    if (l->type == LIST_RING) {
+        err = ring_add_last(l, val);
+    } else if (l->type == LIST_COMPACT) {
+        err = pool_add_last(l, val);
+    } else {
+        err = linked_add_last(l, val, &new_tail);
+    }
 
-    l->size++;
+    if (e != NULL) {
+        *e = new_tail;
+    }
 
-    if (l->size == 1) {
-        l->head = l->tail;
+    if (err == LIST_OK) {
+        parallel_parts_add_last(l);
     }
+
+    return err;
 }
 
 /*
-** list_add_first(): add an element to the list at the first position
+** list_add_first_element(): add an element at the first position and hand
+**                           back its node, for list_remove_element()
 ** in  <- l:   list
 **     <- val: value of the element to add
-** out -> none
+**     <- e:   where to store the new element (NULL on ring and compact
+**             lists, whose values have no node), or NULL
+** out -> LIST_OK, LIST_ERR_FULL if a bounded ring list is full,
+**        LIST_ERR_NOMEM if out of memory
 */
-void list_add_first(list_t *l, void *val)
+int list_add_first_element(list_t *l, void *val, element_t **e)
 {
-    element_t *new_head = (element_t *)malloc(sizeof(element_t));
-    element_t *old_head = l->head;
+    element_t *new_head = NULL;
+    int err;
 
-    new_head->val  = val;
-    new_head->next = old_head;
-    new_head->prev = NULL;
-
-    if (old_head != NULL) {
-        old_head->prev = new_head;
+    if (l->type == LIST_RING) {
+        err = ring_add_first(l, val);
+    } else if (l->type == LIST_COMPACT) {
+        err = pool_add_first(l, val);
+    } else {
+        err = linked_add_first(l, val, &new_head);
     }
 
-    l->head = new_head;
-
-    l->size++;
+    if (e != NULL) {
+        *e = new_head;
+    }
 
-    if (l->size == 1) {
-        l->tail = l->head;
+    if (err == LIST_OK) {
+        parallel_parts_add_first(l);
     }
+
+    return err;
 }
 
 /*
 ** list_remove(): remove an element from the list
 ** in  <- l:   list
 **     <- val: value of the element to remove
-** out -> none
+** out -> LIST_OK, LIST_ERR_EMPTY or LIST_ERR_NOT_FOUND
 */
-void list_remove(list_t *l, void *val)
+int list_remove(list_t *l, void *val)
 {
     element_t *e = l->head;
+    uint32_t i;
+
+    if (!l->size) {
+        return LIST_ERR_EMPTY;
+    }
+
+    l->nparts = 0;
+
+    if (l->type == LIST_RING) {
+        return ring_remove_pos(l, list_find(l, val));
+    }
+
+    if (l->type == LIST_COMPACT) {
+        i = pool_find(l, val);
+        if (i == LIST_NIL) {
+            return LIST_ERR_NOT_FOUND;
+        }
+        pool_remove(l, i);
+        return LIST_OK;
+    }
 
+    e = skip_dead(e);
     while (e != NULL) {
         if (e->val == val) {
-            remove_element(l, e);
-            return;
+            kill_element(l, e);
+            return LIST_OK;
         }
-        e = e->next;
+        e = skip_dead(e->next);
     }
+
+    return LIST_ERR_NOT_FOUND;
 }
 
 /*
 ** list_remove_pos(): remove an element from the list
 ** in  <- l:   list
 **     <- pos: position of the element to remove
-** out -> none
+** out -> LIST_OK, LIST_ERR_EMPTY or LIST_ERR_NOT_FOUND
 */
-void list_remove_pos(list_t *l, int pos)
+int list_remove_pos(list_t *l, int pos)
 {
     element_t *e = l->head;
+    uint32_t n;
     int i = 0;
 
-    while (e != NULL) {
+    if (!l->size) {
+        return LIST_ERR_EMPTY;
+    }
+
+    l->nparts = 0;
+
+    if (l->type == LIST_RING) {
+        return ring_remove_pos(l, pos);
+    }
+
+    if (l->type == LIST_COMPACT) {
+        n = pool_find_pos(l, pos);
+        if (n == LIST_NIL) {
+            return LIST_ERR_NOT_FOUND;
+        }
+        pool_remove(l, n);
+        return LIST_OK;
+    }
+
+    e = skip_dead(e);
+    while (e != NULL) {
         if (i == pos) {
-            remove_element(l, e);
-            return;
+            kill_element(l, e);
+            return LIST_OK;
         }
         i++;
-        e = e->next;
+        e = skip_dead(e->next);
     }
+
+    return LIST_ERR_NOT_FOUND;
 }
 
 /*
-** list_sort(): sort the list from the smallest value to the biggest
-** in  <- l: list
+** list_remove_element(): remove an element of a linked list in O(1)
+** in  <- l: linked list
+**     <- e: live element of l, as handed back by list_add_last_element()
+**           or list_add_first_element(); a handle dies as soon as its
+**           element is removed by any call, since a later compaction
+**           may free the node at any time, so it must not be reused
+** out -> LIST_OK, LIST_ERR_NOT_FOUND if e is NULL or l is not a linked list
+**        (ring and compact lists hand back NULL handles)
+*/
+int list_remove_element(list_t *l, element_t *e)
+{
+    if ((e == NULL) || (l->type != LIST_LINKED)) {
+        return LIST_ERR_NOT_FOUND;
+    }
+
+    l->nparts = 0;
+
+    kill_element(l, e);
+
+    return LIST_OK;
+}
+
+/*
+** list_set_lazy(): enable or disable deferred deletion on a linked list;
+**                  while enabled, removed elements stay linked as tombstones
+**                  until list_compact() frees them
+** in  <- l:         linked list
+**     <- lazy:      true to defer deletions
+**     <- threshold: compact automatically once this many tombstones exist
+**                   (0: only compact on explicit list_compact() calls)
 ** out -> none
 */
-void list_sort(list_t *l)
+void list_set_lazy(list_t *l, bool lazy, int threshold)
+{
+    l->lazy           = lazy && (l->type == LIST_LINKED);
+    l->dead_threshold = threshold;
+
+    if (!l->lazy) {
+        list_compact(l);
+    }
+}
+
+/*
+** list_compact(): unlink and free every tombstone; tombstones are chained
+**                 through their value, so this costs O(tombstones) rather
+**                 than a walk of the whole list
+** in  <- l: list
+** out -> number of elements freed
+*/
+int list_compact(list_t *l)
+{
+    element_t *e = l->graveyard;
+    element_t *next;
+    int count = l->dead;
+
+    if (count) {
+        l->nparts = 0;
+    }
+
+    while (e != NULL) {
+        next = (element_t *)e->val;
+        remove_element(l, e);
+        e = next;
+    }
+
+    l->graveyard = NULL;
+
+    return count;
+}
+
+/*
+** list_sort(): sort the list from the smallest value to the biggest without
+**              allocating or freeing elements; linked nodes are sorted in a
+**              scratch array and relinked so every handle keeps its value
+**              (tombstones go after the live nodes), the other types have
+**              no handles and get their values sorted in place
+** in  <- l: list
+** out -> LIST_OK, LIST_ERR_NOMEM (in which case the list is left untouched)
+*/
+int list_sort(list_t *l)
 {
-    list_t *left;
-    list_t *right;
-    int val;
+    void **vals;
+    cursor_t c;
+    element_t *e;
+    int n = l->size + l->dead;
+    int live = 0;
     int i;
 
     if (l->size <= 1) {
-        return;
+        return LIST_OK;
+    }
+
+    vals = (void **)mem_alloc(l, n * sizeof(void *));
+    if (vals == NULL) {
+        return LIST_ERR_NOMEM;
     }
 
-    left  = list_create();
-    right = list_create();
+    if (l->type != LIST_LINKED) {
+        cursor_begin(l, &c);
+        for (i = 0; i < l->size; i++, cursor_next(l, &c)) {
+            vals[i] = *cursor_slot(l, &c);
+        }
+
+        qsort(vals, l->size, sizeof(void *), compare_values);
+
+        cursor_begin(l, &c);
+        for (i = 0; i < l->size; i++, cursor_next(l, &c)) {
+            *cursor_slot(l, &c) = vals[i];
+        }
+
+        mem_free(l, vals, n * sizeof(void *));
+
+        return LIST_OK;
+    }
 
-    for (i = 0; i < l->size; i++) {
-        val = list_find_pos(l, i);
-        if (i < (l->size / 2)) {
-            list_add_last(left, val);
+    i = l->size;
+    for (e = l->head; e != NULL; e = e->next) {
+        if (is_dead(e)) {
+            vals[i++] = e;
         } else {
-            list_add_last(right, val);
+            vals[live++] = e;
         }
     }
 
-    list_sort(left);
-    list_sort(right);
+    qsort(vals, l->size, sizeof(void *), compare_elements);
 
-    list_merge(left, right, l);
+    for (i = 0; i < n; i++) {
+        e = (element_t *)vals[i];
+        set_prev(e, (i > 0) ? (element_t *)vals[i - 1] : NULL);
+        e->next = (i < n - 1) ? (element_t *)vals[i + 1] : NULL;
+    }
+
+    l->head   = (element_t *)vals[0];
+    l->tail   = (element_t *)vals[n - 1];
+    l->nparts = 0;
 
-    list_destroy(left);
-    list_destroy(right);
+    mem_free(l, vals, n * sizeof(void *));
+
+    return LIST_OK;
 }
 
 
@@ -305,29 +1065,264 @@ void list_sort(list_t *l)
 ** in  <- left:   first ordered list
 **     <- right:  second ordered list
 ** out -> result: merged list
+**     -> LIST_OK, LIST_ERR_NOMEM (values not merged yet stay in left/right)
 */
-void list_merge(list_t *left, list_t *right, list_t *result)
+int list_merge(list_t *left, list_t *right, list_t *result)
 {
+    list_t *from;
+    int err;
+
     list_clear(result);
 
-    while ((list_is_not_empty(left)) && (list_is_not_empty(right))) {
-        if (list_first(left) <= list_first(right)) {
-            list_add_last(result, list_first(left));
-            list_remove_pos(left, 0);
+    while ((list_is_not_empty(left)) || (list_is_not_empty(right))) {
+        if (list_is_empty(right) || (list_is_not_empty(left) &&
+                                     (list_first(left) <= list_first(right)))) {
+            from = left;
         } else {
-            list_add_last(result, list_first(right));
-            list_remove_pos(right, 0);
+            from = right;
+        }
+
+        err = list_add_last(result, (void *)(intptr_t)list_first(from));
+        if (err != LIST_OK) {
+            return err;
+        }
+        list_remove_pos(from, 0);
+    }
+
+    return LIST_OK;
+}
+
+/*
+** list_defragment(): move all elements into a single contiguous block laid
+**                    out in list order to restore traversal locality;
+**                    tombstones are dropped and element handles taken before
+**                    the call become invalid
+** in  <- l: list
+** out -> LIST_OK, LIST_ERR_NOMEM (in which case the list is left untouched)
+*/
+int list_defragment(list_t *l)
+{
+    element_t *nodes;
+    element_t *e;
+    element_t *next;
+    cnode_t *cn;
+    pool_t pool;
+    uint32_t i;
+    int n = 0;
+
+    l->nparts = 0;
+
+    if (l->type == LIST_COMPACT) {
+        if (!pool_init(l, &pool, l->pool.capacity)) {
+            return LIST_ERR_NOMEM;
+        }
+        while (pool.capacity < (uint32_t)l->size) {
+            if (pool_grow(l, &pool) != LIST_OK) {
+                pool_release(l, &pool);
+                return LIST_ERR_NOMEM;
+            }
+        }
+        for (i = l->pool.head; i != LIST_NIL; i = pool_node(l, i)->next) {
+            cn = LIST_POOL_NODE(&pool, (uint32_t)n);
+            cn->val  = pool_node(l, i)->val;
+            cn->prev = n ? (uint32_t)(n - 1) : LIST_NIL;
+            cn->next = (uint32_t)(n + 1);
+            n++;
+        }
+        if (n) {
+            LIST_POOL_NODE(&pool, (uint32_t)(n - 1))->next = LIST_NIL;
+        }
+        pool_release(l, &l->pool);
+        l->pool.blocks    = pool.blocks;
+        l->pool.nblocks   = pool.nblocks;
+        l->pool.maxblocks = pool.maxblocks;
+        l->pool.capacity  = pool.capacity;
+        l->pool.used    = n;
+        l->pool.free    = LIST_NIL;
+        l->pool.head    = n ? 0 : LIST_NIL;
+        l->pool.tail    = n ? (uint32_t)(n - 1) : LIST_NIL;
+        l->pool.ordered = true;
+        return LIST_OK;
+    }
+
+    if (l->type != LIST_LINKED) {
+        return LIST_OK;
+    }
+
+    nodes = NULL;
+    if (l->size) {
+        nodes = (element_t *)mem_alloc(l, l->size * sizeof(element_t));
+        if (nodes == NULL) {
+            return LIST_ERR_NOMEM;
+        }
+    }
+
+    list_compact(l);
+
+    for (e = l->head; e != NULL; e = next) {
+        next = e->next;
+        nodes[n].val    = e->val;
+        nodes[n].prev = (n ? (uintptr_t)&nodes[n - 1] : (uintptr_t)NULL) |
+                        LIST_ELEMENT_POOLED;
+        nodes[n].next = next ? &nodes[n + 1] : NULL;
+        if (!is_pooled(e)) {
+            mem_free(l, e, sizeof(element_t));
+        }
+        n++;
+    }
+
+    mem_free(l, l->slab.nodes, l->slab.size * sizeof(element_t));
+    l->slab.nodes = nodes;
+    l->slab.size  = n;
+    l->slab.used  = n;
+    l->slab.free  = NULL;
+
+    l->head = n ? &nodes[0] : NULL;
+    l->tail = n ? &nodes[n - 1] : NULL;
+
+    return LIST_OK;
+}
+
+/*
+** list_set_threads(): set the number of threads used by parallel operations
+** in  <- l:       list
+**     <- threads: thread count, 0 to use one thread per online CPU
+** out -> none
+*/
+void list_set_threads(list_t *l, int threads)
+{
+    l->threads = (threads < 0) ? 0 : threads;
+    l->nparts  = 0;
+}
+
+/*
+** list_foreach_parallel(): call fn on every value, spreading the list over
+**                          several threads; fn must be thread safe and the
+**                          list must not be modified meanwhile, though other
+**                          parallel operations may run on it
+** in  <- l:   list
+**     <- fn:  callback
+**     <- ctx: opaque pointer passed to fn
+** out -> none
+*/
+void list_foreach_parallel(list_t *l, void (*fn)(void *val, void *ctx),
+                           void *ctx)
+{
+    job_t job = { .l = l, .op = OP_FOREACH, .each = fn, .ctx = ctx };
+    task_t serial;
+    task_t *tasks;
+    int n;
+
+    tasks = parallel_run(&job, &n, &serial);
+    parallel_free(l, tasks, n, &serial);
+}
+
+/*
+** list_map(): replace every value by fn(value), in parallel
+** in  <- l:   list
+**     <- fn:  transformation, must be thread safe
+**     <- ctx: opaque pointer passed to fn
+** out -> none
+*/
+void list_map(list_t *l, void *(*fn)(void *val, void *ctx), void *ctx)
+{
+    job_t job = { .l = l, .op = OP_MAP, .map = fn, .ctx = ctx };
+    task_t serial;
+    task_t *tasks;
+    int n;
+
+    tasks = parallel_run(&job, &n, &serial);
+    parallel_free(l, tasks, n, &serial);
+}
+
+/*
+** list_filter(): build a new list, of the same kind, holding in order the
+**                values for which pred is true; pred runs in parallel
+** in  <- l:    list
+**     <- pred: predicate, must be thread safe
+**     <- ctx:  opaque pointer passed to pred
+** out -> new list, using the allocator of l; NULL if out of memory
+*/
+list_t *list_filter(list_t *l, bool (*pred)(void *val, void *ctx), void *ctx)
+{
+    job_t job = { .l = l, .op = OP_FILTER, .pred = pred, .ctx = ctx };
+    task_t serial;
+    task_t *tasks;
+    list_t *result;
+    bool failed = false;
+    int n;
+    int k;
+    int i;
+
+    tasks = parallel_run(&job, &n, &serial);
+
+    /* the result shares the allocator of l: build it under the list lock
+    ** so that concurrent filters never call the allocator at once */
+    pthread_mutex_lock(&l->lock);
+
+    switch (l->type) {
+    case LIST_RING:
+        result = list_create_ring_with_allocator(l->size, false, &l->alloc);
+        break;
+    case LIST_COMPACT:
+        result = list_create_compact_with_allocator(&l->alloc);
+        break;
+    default:
+        result = list_create_with_allocator(&l->alloc);
+        break;
+    }
+
+    failed = (result == NULL);
+    for (k = 0; k < n; k++) {
+        failed = failed || tasks[k].failed;
+        for (i = 0; !failed && (i < tasks[k].nkept); i++) {
+            failed = (list_add_last(result, tasks[k].kept[i]) != LIST_OK);
         }
     }
 
-    while (list_is_not_empty(left)) {
-        list_add_last(result, list_first(left));
-        list_remove_pos(left, 0);
+    if (failed && (result != NULL)) {
+        list_destroy(result);
+        result = NULL;
     }
-    while (list_is_not_empty(right)) {
-        list_add_last(result, list_first(right));
-        list_remove_pos(right, 0);
+
+    pthread_mutex_unlock(&l->lock);
+
+    parallel_free(l, tasks, n, &serial);
+
+    return result;
+}
+
+/*
+** list_reduce(): fold all values with fn, in parallel; each thread folds its
+**                own chunk starting from init, then the partial results are
+**                folded in list order, so fn must be associative and init
+**                its identity
+** in  <- l:    list
+**     <- fn:   combiner, must be thread safe
+**     <- init: identity value of fn
+**     <- ctx:  opaque pointer passed to fn
+** out -> result
+*/
+void *list_reduce(list_t *l, void *(*fn)(void *acc, void *val, void *ctx),
+                  void *init, void *ctx)
+{
+    job_t job = { .l = l, .op = OP_REDUCE, .reduce = fn, .init = init,
+                  .ctx = ctx };
+    task_t serial;
+    task_t *tasks;
+    void *acc = init;
+    int n;
+    int k;
+
+    tasks = parallel_run(&job, &n, &serial);
+
+    for (k = 0; k < n; k++) {
+        acc = fn(acc, tasks[k].acc, ctx);
     }
+
+    parallel_free(l, tasks, n, &serial);
+
+    return acc;
 }
 
 
@@ -336,29 +1331,1281 @@ void list_merge(list_t *left, list_t *right, list_t *result)
 */
 
 /*
-** remove_element(): remove an element from the list
+** alloc_element(): get a new linked list element, reusing a free slot of the
+**                  defragmented block first
+** in  <- l: list
+** out -> element, NULL if out of memory
+*/
+static element_t *alloc_element(list_t *l)
+{
+    element_t *e = l->slab.free;
+
+    if (e != NULL) {
+        l->slab.free = e->next;
+        l->slab.used++;
+        e->prev = LIST_ELEMENT_POOLED;
+        return e;
+    }
+
+    e = (element_t *)mem_alloc(l, sizeof(element_t));
+    if (e != NULL) {
+        e->prev = (uintptr_t)NULL;
+    }
+
+    return e;
+}
+
+/*
+** linked_add_last(): append a new element to a linked list
+** in  <- l:   linked list
+**     <- val: value of the element to add
+**     -> e:   new element
+** out -> LIST_OK, LIST_ERR_NOMEM if out of memory
+*/
+static int linked_add_last(list_t *l, void *val, element_t **e)
+{
+    element_t *new_tail = alloc_element(l);
+    element_t *old_tail = l->tail;
+
+    if (new_tail == NULL) {
+        return LIST_ERR_NOMEM;
+    }
+
+    new_tail->val  = val;
+    new_tail->next = NULL;
+    set_prev(new_tail, old_tail);
+
+    if (old_tail != NULL) {
+        old_tail->next = new_tail;
+    } else {
+        l->head = new_tail;
+    }
+
+    l->tail = new_tail;
+    l->size++;
+
+    *e = new_tail;
+
+    return LIST_OK;
+}
+
+/*
+** linked_add_first(): prepend a new element to a linked list
+** in  <- l:   linked list
+**     <- val: value of the element to add
+**     -> e:   new element
+** out -> LIST_OK, LIST_ERR_NOMEM if out of memory
+*/
+static int linked_add_first(list_t *l, void *val, element_t **e)
+{
+    element_t *new_head = alloc_element(l);
+    element_t *old_head = l->head;
+
+    if (new_head == NULL) {
+        return LIST_ERR_NOMEM;
+    }
+
+    new_head->val  = val;
+    new_head->next = old_head;
+    set_prev(new_head, NULL);
+
+    if (old_head != NULL) {
+        set_prev(old_head, new_head);
+    } else {
+        l->tail = new_head;
+    }
+
+    l->head = new_head;
+    l->size++;
+
+    *e = new_head;
+
+    return LIST_OK;
+}
+
+/*
+** remove_element(): unlink and free an element, tombstone or not
 ** in  <- l: list
 **     <- e: element to remove
 ** out -> none
 */
 static void remove_element(list_t *l, element_t *e)
 {
-    if (l->size == 1) {
-        l->head = NULL;
-        l->tail = NULL;
-    } else if (e == l->head) {
+    element_t *prev = LIST_PREV(e);
+
+    if (prev != NULL) {
+        prev->next = e->next;
+    } else {
         l->head = e->next;
-        l->head->prev = NULL;
-    } else if (e == l->tail) {
-        l->tail = e->prev;
-        l->tail->next = NULL;
+    }
+
+    if (e->next != NULL) {
+        set_prev(e->next, prev);
+    } else {
+        l->tail = prev;
+    }
+
+    if (is_dead(e)) {
+        l->dead--;
+    } else {
+        l->size--;
+    }
+
+    if (is_pooled(e)) {
+        e->next = l->slab.free;
+        l->slab.free = e;
+        l->slab.used--;
     } else {
-        e->prev->next = e->next;
-        e->next->prev = e->prev;
+        mem_free(l, e, sizeof(element_t));
     }
+}
 
-    free(e);
+/*
+** kill_element(): remove a live element, either right away or, on a lazy
+**                 list, by turning it into a tombstone pushed on the
+**                 graveyard chain (its value is no longer needed)
+** in  <- l: list
+**     <- e: element to remove
+** out -> none
+*/
+static void kill_element(list_t *l, element_t *e)
+{
+    if (!l->lazy) {
+        remove_element(l, e);
+        return;
+    }
 
+    e->prev     |= LIST_ELEMENT_DEAD;
+    e->val       = l->graveyard;
+    l->graveyard = e;
     l->size--;
+    l->dead++;
+
+    if (l->dead_threshold && (l->dead >= l->dead_threshold)) {
+        list_compact(l);
+    }
+}
+
+/*
+** set_prev(): relink the previous element of e, keeping its flags
+** in  <- e:    element
+**     <- prev: new previous element or NULL
+** out -> none
+*/
+static void set_prev(element_t *e, element_t *prev)
+{
+    e->prev = (uintptr_t)prev | (e->prev & LIST_ELEMENT_FLAGS);
+}
+
+/*
+** is_dead(): tell whether an element is a tombstone
+** in  <- e: element
+** out -> true if e was removed from a lazy list and awaits compaction
+*/
+static bool is_dead(const element_t *e)
+{
+    return (e->prev & LIST_ELEMENT_DEAD) != 0;
+}
+
+/*
+** is_pooled(): tell whether an element lives in the block of
+**              list_defragment() rather than in its own allocation
+** in  <- e: element
+** out -> true if e belongs to l->slab
+*/
+static bool is_pooled(const element_t *e)
+{
+    return (e->prev & LIST_ELEMENT_POOLED) != 0;
+}
+
+/*
+** prefetch_element(): prefetch the element LIST_PREFETCH_DISTANCE slots
+**                     after e in the block of list_defragment(), which
+**                     holds the list in order; e->next is already on its
+**                     way when this runs, so prefetching it hides nothing,
+**                     and scattered elements have no known successor
+** in  <- l: linked list
+**     <- e: element being visited
+** out -> none
+*/
+static void prefetch_element(list_t *l, element_t *e)
+{
+    if (is_pooled(e) &&
+        ((e - l->slab.nodes) + LIST_PREFETCH_DISTANCE < l->slab.size)) {
+        LIST_PREFETCH(e + LIST_PREFETCH_DISTANCE);
+    }
+}
+
+/*
+** prefetch_node(): prefetch the node LIST_PREFETCH_DISTANCE slots after i,
+**                  only while the pool is laid out in list order
+** in  <- l: compact list
+**     <- i: index of the node being visited
+** out -> none
+*/
+static void prefetch_node(list_t *l, uint32_t i)
+{
+    if (l->pool.ordered && ((i + LIST_PREFETCH_DISTANCE) < l->pool.used)) {
+        LIST_PREFETCH(pool_node(l, i + LIST_PREFETCH_DISTANCE));
+    }
+}
+
+/*
+** skip_dead(): return the first live element at or after e
+** in  <- e: element or NULL
+** out -> live element or NULL
+*/
+static element_t *skip_dead(element_t *e)
+{
+    while ((e != NULL) && is_dead(e)) {
+        e = e->next;
+    }
+
+    return e;
+}
+
+/*
+** skip_dead_prev(): return the last live element at or before e
+** in  <- e: element or NULL
+** out -> live element or NULL
+*/
+static element_t *skip_dead_prev(element_t *e)
+{
+    while ((e != NULL) && is_dead(e)) {
+        e = LIST_PREV(e);
+    }
+
+    return e;
 }
 
+/*
+** ring_index(): translate a list position into a ring buffer slot
+** in  <- l:   ring list
+**     <- pos: position in the list (0 <= pos < capacity)
+** out -> slot index in l->ring.buf
+*/
+static int ring_index(list_t *l, int pos)
+{
+    int i = l->ring.start + pos;
+
+    return (i >= l->ring.capacity) ? (i - l->ring.capacity) : i;
+}
+
+/*
+** ring_grow(): double the capacity of an unbounded ring list
+** in  <- l: ring list
+** out -> LIST_OK, LIST_ERR_FULL if the list is bounded, LIST_ERR_NOMEM
+*/
+static int ring_grow(list_t *l)
+{
+    void **buf;
+    int capacity = l->ring.capacity * 2;
+    int head_len;
+
+    if (l->ring.bounded) {
+        return LIST_ERR_FULL;
+    }
+
+    buf = (void **)mem_alloc(l, capacity * sizeof(void *));
+    if (buf == NULL) {
+        return LIST_ERR_NOMEM;
+    }
+
+    /* unwrap the content so that it starts at slot 0 */
+    head_len = l->ring.capacity - l->ring.start;
+    if (head_len > l->size) {
+        head_len = l->size;
+    }
+    memcpy(buf, l->ring.buf + l->ring.start, head_len * sizeof(void *));
+    memcpy(buf + head_len, l->ring.buf, (l->size - head_len) * sizeof(void *));
+
+    mem_free(l, l->ring.buf, l->ring.capacity * sizeof(void *));
+
+    l->ring.buf      = buf;
+    l->ring.capacity = capacity;
+    l->ring.start    = 0;
+
+    return LIST_OK;
+}
+
+/*
+** ring_add_last(): append a value to a ring list
+** in  <- l:   ring list
+**     <- val: value to add
+** out -> LIST_OK, LIST_ERR_FULL if bounded and full, LIST_ERR_NOMEM
+*/
+static int ring_add_last(list_t *l, void *val)
+{
+    int err;
+
+    if (l->size == l->ring.capacity) {
+        err = ring_grow(l);
+        if (err != LIST_OK) {
+            return err;
+        }
+    }
+
+    l->ring.buf[ring_index(l, l->size)] = val;
+    l->size++;
+
+    return LIST_OK;
+}
+
+/*
+** ring_add_first(): prepend a value to a ring list
+** in  <- l:   ring list
+**     <- val: value to add
+** out -> LIST_OK, LIST_ERR_FULL if bounded and full, LIST_ERR_NOMEM
+*/
+static int ring_add_first(list_t *l, void *val)
+{
+    int err;
+
+    if (l->size == l->ring.capacity) {
+        err = ring_grow(l);
+        if (err != LIST_OK) {
+            return err;
+        }
+    }
+
+    l->ring.start = ring_index(l, l->ring.capacity - 1);
+    l->ring.buf[l->ring.start] = val;
+    l->size++;
+
+    return LIST_OK;
+}
+
+/*
+** ring_remove_pos(): remove a value from a ring list, closing the gap by
+**                    shifting the shorter side
+** in  <- l:   ring list
+**     <- pos: position of the value to remove
+** out -> LIST_OK, LIST_ERR_EMPTY or LIST_ERR_NOT_FOUND
+*/
+static int ring_remove_pos(list_t *l, int pos)
+{
+    int i;
+
+    if (!l->size) {
+        return LIST_ERR_EMPTY;
+    }
+
+    if ((pos < 0) || (pos >= l->size)) {
+        return LIST_ERR_NOT_FOUND;
+    }
+
+    if (pos < (l->size / 2)) {
+        for (i = pos; i > 0; i--) {
+            l->ring.buf[ring_index(l, i)] = l->ring.buf[ring_index(l, i - 1)];
+        }
+        l->ring.start = ring_index(l, 1);
+    } else {
+        for (i = pos; i < (l->size - 1); i++) {
+            l->ring.buf[ring_index(l, i)] = l->ring.buf[ring_index(l, i + 1)];
+        }
+    }
+
+    l->size--;
+
+    if (!l->size) {
+        l->ring.start = 0;
+    }
+
+    return LIST_OK;
+}
+
+/*
+** pool_node(): address of a node of a compact list
+** in  <- l: compact list
+**     <- i: node index
+** out -> node
+*/
+static cnode_t *pool_node(list_t *l, uint32_t i)
+{
+    return LIST_POOL_NODE(&l->pool, i);
+}
+
+/*
+** pool_init(): give an empty pool its first block
+** in  <- l:        list whose allocator is used
+**     -> p:        pool
+**     <- capacity: wanted number of nodes, clamped to LIST_POOL_BLOCK_SIZE
+** out -> true on success, false if out of memory
+*/
+static bool pool_init(list_t *l, pool_t *p, uint32_t capacity)
+{
+    if (capacity > LIST_POOL_BLOCK_SIZE) {
+        capacity = LIST_POOL_BLOCK_SIZE;
+    }
+
+    p->blocks = (cnode_t **)mem_alloc(l, sizeof(cnode_t *));
+    if (p->blocks == NULL) {
+        return false;
+    }
+
+    p->blocks[0] = (cnode_t *)mem_alloc(l, capacity * sizeof(cnode_t));
+    if (p->blocks[0] == NULL) {
+        mem_free(l, p->blocks, sizeof(cnode_t *));
+        p->blocks = NULL;
+        return false;
+    }
+
+    p->nblocks   = 1;
+    p->maxblocks = 1;
+    p->capacity  = capacity;
+
+    return true;
+}
+
+/*
+** pool_grow(): add room to a pool; the first block doubles until it reaches
+**              LIST_POOL_BLOCK_SIZE nodes, so that small lists stay small,
+**              then whole blocks are added, so that nodes never move and at
+**              most one block is unused
+** in  <- l: list whose allocator is used
+**     <> p: pool
+** out -> LIST_OK, LIST_ERR_FULL if 32-bit indices are exhausted,
+**        LIST_ERR_NOMEM
+*/
+static int pool_grow(list_t *l, pool_t *p)
+{
+    cnode_t **blocks;
+    cnode_t *nodes;
+    uint32_t size;
+
+    if (p->capacity < LIST_POOL_BLOCK_SIZE) {
+        size = 2 * p->capacity;
+        if (size > LIST_POOL_BLOCK_SIZE) {
+            size = LIST_POOL_BLOCK_SIZE;
+        }
+        nodes = (cnode_t *)mem_alloc(l, size * sizeof(cnode_t));
+        if (nodes == NULL) {
+            return LIST_ERR_NOMEM;
+        }
+        memcpy(nodes, p->blocks[0], p->capacity * sizeof(cnode_t));
+        mem_free(l, p->blocks[0], p->capacity * sizeof(cnode_t));
+        p->blocks[0] = nodes;
+        p->capacity  = size;
+        return LIST_OK;
+    }
+
+    if (p->capacity > LIST_NIL - LIST_POOL_BLOCK_SIZE) {
+        return LIST_ERR_FULL;
+    }
+
+    if (p->nblocks == p->maxblocks) {
+        blocks = (cnode_t **)mem_alloc(l, 2 * p->maxblocks *
+                                       sizeof(cnode_t *));
+        if (blocks == NULL) {
+            return LIST_ERR_NOMEM;
+        }
+        memcpy(blocks, p->blocks, p->nblocks * sizeof(cnode_t *));
+        mem_free(l, p->blocks, p->maxblocks * sizeof(cnode_t *));
+        p->blocks     = blocks;
+        p->maxblocks *= 2;
+    }
+
+    nodes = (cnode_t *)mem_alloc(l, LIST_POOL_BLOCK_SIZE * sizeof(cnode_t));
+    if (nodes == NULL) {
+        return LIST_ERR_NOMEM;
+    }
+    p->blocks[p->nblocks++] = nodes;
+    p->capacity += LIST_POOL_BLOCK_SIZE;
+
+    return LIST_OK;
+}
+
+/*
+** pool_release(): free every block of a pool and its block table
+** in  <- l: list whose allocator is used
+**     <> p: pool
+** out -> none
+*/
+static void pool_release(list_t *l, pool_t *p)
+{
+    uint32_t k;
+
+    if (p->blocks == NULL) {
+        return;
+    }
+
+    mem_free(l, p->blocks[0], (p->capacity < LIST_POOL_BLOCK_SIZE ?
+                               p->capacity : LIST_POOL_BLOCK_SIZE) *
+                              sizeof(cnode_t));
+    for (k = 1; k < p->nblocks; k++) {
+        mem_free(l, p->blocks[k], LIST_POOL_BLOCK_SIZE * sizeof(cnode_t));
+    }
+    mem_free(l, p->blocks, p->maxblocks * sizeof(cnode_t *));
+
+    p->blocks    = NULL;
+    p->nblocks   = 0;
+    p->maxblocks = 0;
+}
+
+/*
+** pool_alloc(): take a free node from the pool of a compact list, growing the
+**               pool if needed; the node is returned unlinked
+** in  <- l:   compact list
+**     <- val: value of the node
+**     -> i:   node index
+** out -> LIST_OK, LIST_ERR_FULL if 32-bit indices are exhausted,
+**        LIST_ERR_NOMEM
+*/
+static int pool_alloc(list_t *l, void *val, uint32_t *i)
+{
+    int err;
+
+    if (l->pool.free != LIST_NIL) {
+        *i = l->pool.free;
+        l->pool.free = pool_node(l, *i)->next;
+        l->pool.ordered = false;
+    } else {
+        if (l->pool.used == l->pool.capacity) {
+            err = pool_grow(l, &l->pool);
+            if (err != LIST_OK) {
+                return err;
+            }
+        }
+        *i = l->pool.used++;
+    }
+
+    pool_node(l, *i)->val  = val;
+    pool_node(l, *i)->next = LIST_NIL;
+    pool_node(l, *i)->prev = LIST_NIL;
+
+    return LIST_OK;
+}
+
+/*
+** pool_add_last(): append a new node to a compact list
+** in  <- l:   compact list
+**     <- val: value of the node to add
+** out -> LIST_OK, or the error of pool_alloc()
+*/
+static int pool_add_last(list_t *l, void *val)
+{
+    uint32_t i;
+    int err = pool_alloc(l, val, &i);
+
+    if (err != LIST_OK) {
+        return err;
+    }
+
+    pool_node(l, i)->prev = l->pool.tail;
+    if (l->pool.tail != LIST_NIL) {
+        pool_node(l, l->pool.tail)->next = i;
+    } else {
+        l->pool.head = i;
+    }
+    l->pool.tail = i;
+    l->size++;
+
+    return LIST_OK;
+}
+
+/*
+** pool_add_first(): prepend a new node to a compact list
+** in  <- l:   compact list
+**     <- val: value of the node to add
+** out -> LIST_OK, or the error of pool_alloc()
+*/
+static int pool_add_first(list_t *l, void *val)
+{
+    uint32_t i;
+    int err = pool_alloc(l, val, &i);
+
+    if (err != LIST_OK) {
+        return err;
+    }
+
+    pool_node(l, i)->next = l->pool.head;
+    if (l->pool.head != LIST_NIL) {
+        pool_node(l, l->pool.head)->prev = i;
+        l->pool.ordered = false;
+    } else {
+        l->pool.tail = i;
+    }
+    l->pool.head = i;
+    l->size++;
+
+    return LIST_OK;
+}
+
+/*
+** pool_remove(): unlink a node from a compact list and return it to the pool
+** in  <- l: compact list
+**     <- i: node index
+** out -> none
+*/
+static void pool_remove(list_t *l, uint32_t i)
+{
+    cnode_t *n = pool_node(l, i);
+
+    if (n->prev != LIST_NIL) {
+        pool_node(l, n->prev)->next = n->next;
+    } else {
+        l->pool.head = n->next;
+    }
+
+    if (n->next != LIST_NIL) {
+        pool_node(l, n->next)->prev = n->prev;
+    } else {
+        l->pool.tail = n->prev;
+    }
+
+    n->next = l->pool.free;
+    l->pool.free = i;
+
+    l->size--;
+}
+
+/*
+** pool_find(): find a node of a compact list by value
+** in  <- l:   compact list
+**     <- val: value of the node to find
+** out -> node index, LIST_NIL if not found
+*/
+static uint32_t pool_find(list_t *l, void *val)
+{
+    uint32_t i;
+
+    for (i = l->pool.head; i != LIST_NIL; i = pool_node(l, i)->next) {
+        if (pool_node(l, i)->val == val) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/*
+** pool_find_pos(): find a node of a compact list by position, walking from
+**                  whichever end is closer
+** in  <- l:   compact list
+**     <- pos: position of the node to find
+** out -> node index, LIST_NIL if out of range
+*/
+static uint32_t pool_find_pos(list_t *l, int pos)
+{
+    uint32_t i;
+    int n;
+
+    if ((pos < 0) || (pos >= l->size)) {
+        return LIST_NIL;
+    }
+
+    if (pos <= (l->size / 2)) {
+        i = l->pool.head;
+        for (n = 0; n < pos; n++) {
+            i = pool_node(l, i)->next;
+        }
+    } else {
+        i = l->pool.tail;
+        for (n = l->size - 1; n > pos; n--) {
+            i = pool_node(l, i)->prev;
+        }
+    }
+
+    return i;
+}
+
+/*
+** cursor_begin(): point a cursor at the first live value of a list
+** in  <- l: list
+**     -> c: cursor
+** out -> none
+*/
+static void cursor_begin(list_t *l, cursor_t *c)
+{
+    c->e   = skip_dead(l->head);
+    c->i   = l->pool.head;
+    c->pos = 0;
+}
+
+/*
+** cursor_next(): move a cursor to the next live value
+** in  <- l: list
+**     <> c: cursor
+** out -> none
+*/
+static void cursor_next(list_t *l, cursor_t *c)
+{
+    if (l->type == LIST_LINKED) {
+        c->e = skip_dead(c->e->next);
+    } else if (l->type == LIST_COMPACT) {
+        c->i = pool_node(l, c->i)->next;
+    }
+
+    c->pos++;
+}
+
+/*
+** cursor_slot(): address of the value a cursor points at
+** in  <- l: list
+**     <- c: cursor
+** out -> value slot
+*/
+static void **cursor_slot(list_t *l, cursor_t *c)
+{
+    if (l->type == LIST_RING) {
+        return &l->ring.buf[ring_index(l, c->pos)];
+    }
+
+    if (l->type == LIST_COMPACT) {
+        return &pool_node(l, c->i)->val;
+    }
+
+    return &c->e->val;
+}
+
+/*
+** parallel_parts(): split the list into one chunk per thread; the chunk
+**                   start cursors are cached in l->parts and kept up to
+**                   date by the add functions, so that after appends only
+**                   the boundaries move forward and the list is walked
+**                   again only after other modifications; must be called
+**                   with l->lock held
+** in  <- l: list
+** out -> number of chunks, 0 if out of memory; l->parts[n].pos is the end of
+**        the last chunk
+*/
+static int parallel_parts(list_t *l)
+{
+    cursor_t *parts;
+    cursor_t c;
+    int n = l->threads;
+    int target;
+    int k;
+
+    if (!n) {
+        n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if ((n < 1) || (l->size < LIST_PARALLEL_MIN_SIZE)) {
+        n = 1;
+    }
+
+    if (n == l->nparts) {
+        for (k = 1; k < n; k++) {
+            target = (int)((long long)k * l->size / n);
+            while (l->parts[k].pos < target) {
+                cursor_next(l, &l->parts[k]);
+            }
+            /* prepends only push boundaries back: rebuild once a chunk
+            ** is half again as big as it should be */
+            if (l->parts[k].pos > target + l->size / (2 * n)) {
+                break;
+            }
+        }
+        if (k >= n) {
+            return n;
+        }
+    }
+
+    if (n + 1 > l->maxparts) {
+        parts = (cursor_t *)mem_alloc(l, (n + 1) * sizeof(cursor_t));
+        if (parts == NULL) {
+            return 0;
+        }
+        mem_free(l, l->parts, l->maxparts * sizeof(cursor_t));
+        l->parts    = parts;
+        l->maxparts = n + 1;
+    }
+
+    cursor_begin(l, &c);
+    for (k = 0; k < n; k++) {
+        while (c.pos < (int)((long long)k * l->size / n)) {
+            cursor_next(l, &c);
+        }
+        l->parts[k] = c;
+    }
+    l->parts[n].pos = l->size;
+
+    l->nparts = n;
+
+    return n;
+}
+
+/*
+** parallel_parts_add_last(): account for a value appended to the list in
+**                            the cached chunks; only the last one grows
+** in  <- l: list
+** out -> none
+*/
+static void parallel_parts_add_last(list_t *l)
+{
+    if (!l->nparts) {
+        return;
+    }
+
+    if (l->size == 1) {
+        l->nparts = 0;
+    } else {
+        l->parts[l->nparts].pos = l->size;
+    }
+}
+
+/*
+** parallel_parts_add_first(): account for a value prepended to the list in
+**                             the cached chunks; the first one grows
+** in  <- l: list
+** out -> none
+*/
+static void parallel_parts_add_first(list_t *l)
+{
+    int k;
+
+    if (!l->nparts) {
+        return;
+    }
+
+    for (k = 1; k <= l->nparts; k++) {
+        l->parts[k].pos++;
+    }
+    cursor_begin(l, &l->parts[0]);
+}
+
+/*
+** parallel_task(): run a job on one chunk of the list
+** in  <- arg: task
+** out -> NULL
+*/
+static void *parallel_task(void *arg)
+{
+    task_t *t = (task_t *)arg;
+    job_t *j = t->job;
+    list_t *l = j->l;
+    cursor_t c = t->begin;
+    void **slot;
+
+    t->acc   = j->init;
+    t->nkept = 0;
+
+    if (t->failed) {
+        return NULL;
+    }
+
+    for (; c.pos < t->end; cursor_next(l, &c)) {
+        slot = cursor_slot(l, &c);
+
+        switch (j->op) {
+        case OP_FOREACH:
+            j->each(*slot, j->ctx);
+            break;
+        case OP_MAP:
+            *slot = j->map(*slot, j->ctx);
+            break;
+        case OP_FILTER:
+            if (j->pred(*slot, j->ctx)) {
+                t->kept[t->nkept++] = *slot;
+            }
+            break;
+        case OP_REDUCE:
+            t->acc = j->reduce(t->acc, *slot, j->ctx);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+** parallel_take(): take the next task of a job not started yet, dropping the
+**                  job from the queue once all its tasks are taken; must be
+**                  called with pool_lock held
+** in  <- job: job
+** out -> task, NULL if every task of the job is taken
+*/
+static task_t *parallel_take(job_t *job)
+{
+    job_t **q;
+
+    if (job->next == job->ntasks) {
+        return NULL;
+    }
+
+    if (job->next + 1 == job->ntasks) {
+        for (q = &pool_jobs; *q != job; q = &(*q)->queued) {
+        }
+        *q = job->queued;
+    }
+
+    return &job->tasks[job->next++];
+}
+
+/*
+** parallel_worker(): body of the threads of the worker pool, created on
+**                    demand by parallel_run() and kept for later calls
+** in  <- arg: unused
+** out -> never returns
+*/
+static void *parallel_worker(void *arg)
+{
+    task_t *t;
+
+    pthread_mutex_lock(&pool_lock);
+
+    for (;;) {
+        while (pool_jobs == NULL) {
+            pthread_cond_wait(&pool_work, &pool_lock);
+        }
+        t = parallel_take(pool_jobs);
+
+        pthread_mutex_unlock(&pool_lock);
+        parallel_task(t);
+        pthread_mutex_lock(&pool_lock);
+
+        if (!--t->job->pending) {
+            pthread_cond_broadcast(&pool_done);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+** parallel_run(): run a job over every chunk of the list; the chunks are
+**                 queued for the worker pool, which grows up to one thread
+**                 less than the number of chunks, while the calling thread
+**                 runs the first chunk and then any chunk still queued; if
+**                 memory is short the calling thread processes the whole
+**                 list instead
+** in  <- job:    job to run
+**     <- serial: task used for the single threaded fallback
+**     -> count:  number of tasks
+** out -> tasks, to be released with parallel_free()
+*/
+static task_t *parallel_run(job_t *job, int *count, task_t *serial)
+{
+    list_t *l = job->l;
+    task_t *tasks = NULL;
+    task_t *t;
+    pthread_t thread;
+    int n;
+    int k;
+
+    pthread_mutex_lock(&l->lock);
+    n = parallel_parts(l);
+    if (n) {
+        tasks = (task_t *)mem_alloc(l, n * sizeof(task_t));
+    }
+    for (k = 0; (tasks != NULL) && (k < n); k++) {
+        tasks[k].job   = job;
+        tasks[k].begin = l->parts[k];
+        tasks[k].end   = l->parts[k + 1].pos;
+    }
+
+    if (tasks == NULL) {
+        n = 1;
+        tasks = serial;
+        serial->job = job;
+        serial->end = l->size;
+        cursor_begin(l, &serial->begin);
+    }
+
+    /* the list allocator need not be thread safe: take the filter
+    ** buffers under the list lock rather than in the tasks, as other
+    ** parallel calls on the same list may allocate at the same time */
+    for (k = 0; k < n; k++) {
+        tasks[k].kept   = NULL;
+        tasks[k].failed = false;
+        if (job->op == OP_FILTER) {
+            tasks[k].kept   = (void **)mem_alloc(l,
+                                                 parallel_kept_size(&tasks[k]));
+            tasks[k].failed = (tasks[k].kept == NULL);
+        }
+    }
+    pthread_mutex_unlock(&l->lock);
+
+    job->tasks   = tasks;
+    job->ntasks  = n;
+    job->next    = 1;
+    job->pending = n - 1;
+
+    if (n > 1) {
+        pthread_mutex_lock(&pool_lock);
+        job->queued = pool_jobs;
+        pool_jobs   = job;
+        while ((pool_workers < n - 1) &&
+               !pthread_create(&thread, NULL, parallel_worker, NULL)) {
+            pthread_detach(thread);
+            pool_workers++;
+        }
+        pthread_cond_broadcast(&pool_work);
+        pthread_mutex_unlock(&pool_lock);
+    }
+
+    parallel_task(&tasks[0]);
+
+    pthread_mutex_lock(&pool_lock);
+    while ((t = parallel_take(job)) != NULL) {
+        pthread_mutex_unlock(&pool_lock);
+        parallel_task(t);
+        pthread_mutex_lock(&pool_lock);
+        job->pending--;
+    }
+    while (job->pending) {
+        pthread_cond_wait(&pool_done, &pool_lock);
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    *count = n;
+
+    return tasks;
+}
+
+/*
+** parallel_free(): release the tasks of parallel_run() and their buffers
+**                  under the list lock
+** in  <- l:      list the job ran on
+**     <- tasks:  tasks returned by parallel_run()
+**     <- n:      number of tasks
+**     <- serial: task passed to parallel_run()
+** out -> none
+*/
+static void parallel_free(list_t *l, task_t *tasks, int n, task_t *serial)
+{
+    int k;
+
+    pthread_mutex_lock(&l->lock);
+
+    for (k = 0; k < n; k++) {
+        mem_free(l, tasks[k].kept, parallel_kept_size(&tasks[k]));
+    }
+
+    if (tasks != serial) {
+        mem_free(l, tasks, n * sizeof(task_t));
+    }
+
+    pthread_mutex_unlock(&l->lock);
+}
+
+/*
+** parallel_kept_size(): bytes of the buffer collecting the values a filter
+**                       task keeps (one more slot than the chunk, so that an
+**                       empty chunk does not ask for 0 bytes)
+** in  <- t: task
+** out -> bytes
+*/
+static size_t parallel_kept_size(const task_t *t)
+{
+    return (t->end - t->begin.pos + 1) * sizeof(void *);
+}
+
+/*
+** default_alloc(): list_allocator_default allocation hook
+*/
+static void *default_alloc(size_t size, void *ctx)
+{
+    return malloc(size);
+}
+
+/*
+** default_free(): list_allocator_default release hook
+*/
+static void default_free(void *ptr, size_t size, void *ctx)
+{
+    free(ptr);
+}
+
+/*
+** tl_alloc(): list_allocator_thread_local allocation hook; linked list
+**             elements come from the calling thread's cache when possible
+** in  <- size: bytes
+**     <- ctx:  unused
+** out -> block, NULL if out of memory
+*/
+static void *tl_alloc(size_t size, void *ctx)
+{
+    void *ptr = tl_cache.head;
+
+    if ((size != sizeof(element_t)) || (ptr == NULL)) {
+        return malloc(size);
+    }
+
+    tl_cache.head = *(void **)ptr;
+    tl_cache.count--;
+
+    return ptr;
+}
+
+/*
+** tl_free(): list_allocator_thread_local release hook; linked list elements
+**            go to the calling thread's cache, up to LIST_TL_CACHE_MAX
+** in  <- ptr:  block
+**     <- size: bytes
+**     <- ctx:  unused
+** out -> none
+*/
+static void tl_free(void *ptr, size_t size, void *ctx)
+{
+    if ((size != sizeof(element_t)) || (tl_cache.count >= LIST_TL_CACHE_MAX)) {
+        free(ptr);
+        return;
+    }
+
+    /* have the cache drained when this thread exits */
+    if (!tl_cache.registered) {
+        pthread_once(&tl_once, tl_init);
+        tl_cache.registered = !pthread_setspecific(tl_key, &tl_cache);
+    }
+
+    *(void **)ptr = tl_cache.head;
+    tl_cache.head = ptr;
+    tl_cache.count++;
+}
+
+/*
+** tl_drain(): free every block held by a thread cache
+** in  <- arg: thread cache
+** out -> none
+*/
+static void tl_drain(void *arg)
+{
+    tl_cache_t *cache = (tl_cache_t *)arg;
+    void *next;
+
+    while (cache->head != NULL) {
+        next = *(void **)cache->head;
+        free(cache->head);
+        cache->head = next;
+    }
+
+    cache->count = 0;
+}
+
+/*
+** tl_init(): create the key whose destructor drains thread caches
+*/
+static void tl_init(void)
+{
+    pthread_key_create(&tl_key, tl_drain);
+}
+
+#ifdef LIST_USE_NUMA
+/*
+** numa_local_alloc(): list_allocator_numa_local allocation hook; buffers of
+**                     at least LIST_NUMA_MIN_SIZE bytes are placed on the
+**                     calling thread's NUMA node, smaller blocks (which
+**                     numa_alloc_local() would round up to a page) go
+**                     through the thread local cache
+** in  <- size: bytes
+**     <- ctx:  unused
+** out -> block, NULL if out of memory
+*/
+static void *numa_local_alloc(size_t size, void *ctx)
+{
+    if ((size < LIST_NUMA_MIN_SIZE) || (numa_available() < 0)) {
+        return tl_alloc(size, ctx);
+    }
+
+    return numa_alloc_local(size);
+}
+
+/*
+** numa_local_free(): list_allocator_numa_local release hook
+** in  <- ptr:  block
+**     <- size: bytes
+**     <- ctx:  unused
+** out -> none
+*/
+static void numa_local_free(void *ptr, size_t size, void *ctx)
+{
+    if ((size < LIST_NUMA_MIN_SIZE) || (numa_available() < 0)) {
+        tl_free(ptr, size, ctx);
+        return;
+    }
+
+    numa_free(ptr, size);
+}
+#endif
+
+/*
+** mem_alloc(): allocate memory through the list allocator
+** in  <- l:    list
+**     <- size: bytes
+** out -> block, NULL if out of memory
+*/
+static void *mem_alloc(list_t *l, size_t size)
+{
+    return l->alloc.alloc(size, l->alloc.ctx);
+}
+
+/*
+** mem_free(): release memory obtained with mem_alloc()
+** in  <- l:    list
+**     <- ptr:  block or NULL
+**     <- size: bytes, as requested from mem_alloc()
+** out -> none
+*/
+static void mem_free(list_t *l, void *ptr, size_t size)
+{
+    if (ptr != NULL) {
+        l->alloc.free(ptr, size, l->alloc.ctx);
+    }
+}
+
+/*
+** alloc_storage(): allocate the buffer of a ring or compact list for its
+**                  current capacity
+** in  <- l: list
+** out -> true on success, false if out of memory
+*/
+static bool alloc_storage(list_t *l)
+{
+    if (l->type == LIST_RING) {
+        l->ring.buf = (void **)mem_alloc(l, l->ring.capacity *
+                                         sizeof(void *));
+        return l->ring.buf != NULL;
+    }
+
+    if (l->type == LIST_COMPACT) {
+        return pool_init(l, &l->pool, l->pool.capacity);
+    }
+
+    return true;
+}
+
+/*
+** free_storage(): release every buffer held by an empty list
+** in  <- l: list
+** out -> none
+*/
+static void free_storage(list_t *l)
+{
+    mem_free(l, l->ring.buf, l->ring.capacity * sizeof(void *));
+    pool_release(l, &l->pool);
+    mem_free(l, l->slab.nodes, l->slab.size * sizeof(element_t));
+
+    l->ring.buf   = NULL;
+    l->slab.nodes = NULL;
+    l->slab.size  = 0;
+    l->slab.used  = 0;
+    l->slab.free  = NULL;
+
+    mem_free(l, l->parts, l->maxparts * sizeof(cursor_t));
+    l->parts    = NULL;
+    l->nparts   = 0;
+    l->maxparts = 0;
+}
+
+/*
+** compare_values(): qsort() callback ordering values as list_merge() does
+*/
+static int compare_values(const void *a, const void *b)
+{
+    int x = (int)(intptr_t)*(void * const *)a;
+    int y = (int)(intptr_t)*(void * const *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+** compare_elements(): qsort() callback ordering elements by value
+*/
+static int compare_elements(const void *a, const void *b)
+{
+    int x = (int)(intptr_t)(*(element_t * const *)a)->val;
+    int y = (int)(intptr_t)(*(element_t * const *)b)->val;
+
+    return (x > y) - (x < y);
+}
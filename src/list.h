@@ -15,44 +15,177 @@ extern "C" {
 /*
 ** Includes
 */
+#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+** Defines
+*/
+#define LIST_OK                      0
+#define LIST_ERR_FULL              (-1)
+#define LIST_ERR_EMPTY             (-2)
+#define LIST_ERR_NOT_FOUND         (-3)
+#define LIST_ERR_NOMEM             (-4)
+#define LIST_ERR_NOT_EMPTY         (-5)
+
+#define LIST_RING_DEFAULT_CAPACITY  16
+#define LIST_POOL_DEFAULT_CAPACITY  16
+#define LIST_POOL_BLOCK_SHIFT       12
+#define LIST_POOL_BLOCK_SIZE        (1u << LIST_POOL_BLOCK_SHIFT)
+#define LIST_POOL_NODE(p, i) \
+    (&(p)->blocks[(i) >> LIST_POOL_BLOCK_SHIFT] \
+                 [(i) & (LIST_POOL_BLOCK_SIZE - 1)])
+
+#define LIST_NIL                    UINT32_MAX
+
+#define LIST_PARALLEL_MIN_SIZE      4096
+
+#define LIST_ELEMENT_DEAD           ((uintptr_t)1)
+#define LIST_ELEMENT_POOLED         ((uintptr_t)2)
+#define LIST_ELEMENT_FLAGS          ((uintptr_t)3)
+#define LIST_PREV(e) \
+    ((element_t *)((e)->prev & ~LIST_ELEMENT_FLAGS))
+
+#define LIST_TL_CACHE_MAX           4096
+#define LIST_NUMA_MIN_SIZE          4096
 
 
 /*
 ** Type Declarations
 */
+typedef enum list_type {
+    LIST_LINKED,
+    LIST_RING,
+    LIST_COMPACT
+} list_type_t;
+
+typedef struct list_allocator {
+    void *(*alloc)(size_t size, void *ctx);
+    void  (*free)(void *ptr, size_t size, void *ctx);
+    void   *ctx;
+} list_allocator_t;
+
 typedef struct element {
     void *val;
     struct element *next;
-    struct element *prev;
+    uintptr_t prev;             /* use LIST_PREV(), low bits hold flags */
 } element_t;
 
+typedef struct ring {
+    void **buf;
+    int    capacity;
+    int    start;
+    bool   bounded;
+} ring_t;
+
+typedef struct cnode {
+    void    *val;
+    uint32_t next;
+    uint32_t prev;
+} cnode_t;
+
+typedef struct pool {
+    cnode_t **blocks;
+    uint32_t  nblocks;
+    uint32_t  maxblocks;
+    uint32_t  capacity;
+    uint32_t  used;
+    uint32_t  free;
+    uint32_t  head;
+    uint32_t  tail;
+    bool      ordered;
+} pool_t;
+
+struct cursor;
+
+typedef struct slab {
+    element_t *nodes;
+    int        size;
+    int        used;
+    element_t *free;
+} slab_t;
+
 typedef struct list {
     int size;
     element_t *head;
     element_t *tail;
+    list_type_t type;
+    bool lazy;
+    int dead;
+    int dead_threshold;
+    element_t *graveyard;
+    int threads;
+    int nparts;
+    int maxparts;
+    struct cursor *parts;
+    pthread_mutex_t lock;       /* guards parts/nparts/maxparts */
+    list_allocator_t alloc;
+    list_allocator_t owner;     /* allocator of the list_t itself */
+    slab_t slab;
+    ring_t ring;
+    pool_t pool;
 } list_t ;
 
 
+/*
+** Global Data
+*/
+extern const list_allocator_t list_allocator_default;
+extern const list_allocator_t list_allocator_thread_local;
+#ifdef LIST_USE_NUMA
+extern const list_allocator_t list_allocator_numa_local;
+#endif
+
+
 /*
 ** Function Declarations
 */
 list_t *list_create(void);
+list_t *list_create_ring(int capacity, bool bounded);
+list_t *list_create_compact(void);
+list_t *list_create_with_allocator(const list_allocator_t *a);
+list_t *list_create_ring_with_allocator(int capacity, bool bounded,
+                                        const list_allocator_t *a);
+list_t *list_create_compact_with_allocator(const list_allocator_t *a);
 void    list_destroy(list_t *l);
 void    list_clear(list_t *l);
 void    list_print(list_t *l);
+int     list_set_allocator(list_t *l, const list_allocator_t *a);
+void    list_thread_cache_flush(void);
+size_t  list_memory_usage(list_t *l);
 bool    list_is_empty(list_t *l);
 bool    list_is_not_empty(list_t *l);
+bool    list_is_full(list_t *l);
 int     list_first(list_t* l);
 int     list_last(list_t* l);
+int     list_peek_first(list_t *l, void **val);
+int     list_peek_last(list_t *l, void **val);
+int     list_pop_first(list_t *l, void **val);
+int     list_pop_last(list_t *l, void **val);
 int     list_find(list_t *l, void *val);
 int     list_find_pos(list_t *l, int pos);
-void    list_add_last(list_t *l, void *val);
-void    list_add_first(list_t *l, void *val);
-void    list_remove(list_t *l, void *val);
-void    list_remove_pos(list_t *l, int pos);
-void    list_sort(list_t *l);
-void    list_merge(list_t *left, list_t *right, list_t *result);
+int     list_add_last(list_t *l, void *val);
+int     list_add_first(list_t *l, void *val);
+int     list_add_last_element(list_t *l, void *val, element_t **e);
+int     list_add_first_element(list_t *l, void *val, element_t **e);
+int     list_remove(list_t *l, void *val);
+int     list_remove_pos(list_t *l, int pos);
+int     list_remove_element(list_t *l, element_t *e);
+void    list_set_lazy(list_t *l, bool lazy, int threshold);
+int     list_compact(list_t *l);
+int     list_sort(list_t *l);
+int     list_merge(list_t *left, list_t *right, list_t *result);
+int     list_defragment(list_t *l);
+void    list_set_threads(list_t *l, int threads);
+void    list_foreach_parallel(list_t *l, void (*fn)(void *val, void *ctx),
+                              void *ctx);
+void    list_map(list_t *l, void *(*fn)(void *val, void *ctx), void *ctx);
+list_t *list_filter(list_t *l, bool (*pred)(void *val, void *ctx), void *ctx);
+void   *list_reduce(list_t *l, void *(*fn)(void *acc, void *val, void *ctx),
+                    void *init, void *ctx);
 
 
 #endif /* LIST_H_ */
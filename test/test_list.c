@@ -9,6 +9,8 @@
 /*
 ** Includes
 */
+#include <pthread.h>
+#include <stdlib.h>
 #include "unity.h"
 #include "list.h"
 
@@ -37,6 +39,137 @@ static void fill(list_t *l, int count)
     }
 }
 
+static void check_pop(list_t *l)
+{
+    void *val = NULL;
+
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_EMPTY, list_peek_first(l, &val));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_EMPTY, list_peek_last(l, &val));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_EMPTY, list_pop_first(l, &val));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_EMPTY, list_pop_last(l, &val));
+    TEST_ASSERT_NULL(val);
+
+    list_add_last(l, (void *)(intptr_t)-1);
+    list_add_last(l, (void *)(intptr_t)0);
+    list_add_last(l, (void *)(intptr_t)1);
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_peek_first(l, &val));
+    TEST_ASSERT_EQUAL_INT(-1, (intptr_t)val);
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_peek_last(l, &val));
+    TEST_ASSERT_EQUAL_INT(1, (intptr_t)val);
+    TEST_ASSERT_EQUAL_INT(3, l->size);
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_pop_first(l, &val));
+    TEST_ASSERT_EQUAL_INT(-1, (intptr_t)val);
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_pop_last(l, &val));
+    TEST_ASSERT_EQUAL_INT(1, (intptr_t)val);
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_pop_last(l, &val));
+    TEST_ASSERT_EQUAL_INT(0, (intptr_t)val);
+
+    TEST_ASSERT_TRUE(list_is_empty(l));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_EMPTY, list_pop_first(l, &val));
+}
+
+static void add_to_ctx(void *val, void *ctx)
+{
+    __atomic_add_fetch((long *)ctx, (long)val, __ATOMIC_RELAXED);
+}
+
+static void *double_val(void *val, void *ctx)
+{
+    return (void *)((long)val * 2);
+}
+
+static bool is_odd(void *val, void *ctx)
+{
+    return (long)val & 1;
+}
+
+static void *sum(void *acc, void *val, void *ctx)
+{
+    return (void *)((long)acc + (long)val);
+}
+
+static void check_parallel(list_t *l, int count)
+{
+    list_t *odd;
+    long total = 0;
+    long expected = (long)count * (count - 1) / 2;
+
+    fill(l, count);
+    list_set_threads(l, 4);
+
+    list_foreach_parallel(l, add_to_ctx, &total);
+    TEST_ASSERT_EQUAL_INT64(expected, total);
+
+    TEST_ASSERT_EQUAL_INT64(expected, (long)list_reduce(l, sum, 0, NULL));
+
+    list_map(l, double_val, NULL);
+    TEST_ASSERT_EQUAL_INT(0, list_first(l));
+    TEST_ASSERT_EQUAL_INT(2 * (count - 1), list_last(l));
+    TEST_ASSERT_EQUAL_INT64(2 * expected, (long)list_reduce(l, sum, 0, NULL));
+
+    list_map(l, double_val, NULL);
+    list_add_last(l, 7);
+    list_add_first(l, 3);
+    odd = list_filter(l, is_odd, NULL);
+
+    TEST_ASSERT_EQUAL_INT(l->type, odd->type);
+    TEST_ASSERT_EQUAL_INT(2, odd->size);
+    TEST_ASSERT_EQUAL_INT(3, list_first(odd));
+    TEST_ASSERT_EQUAL_INT(7, list_last(odd));
+
+    list_destroy(odd);
+}
+
+static void *reduce_worker(void *arg)
+{
+    return list_reduce((list_t *)arg, sum, 0, NULL);
+}
+
+static void *budget_alloc(size_t size, void *ctx)
+{
+    int *budget = (int *)ctx;
+
+    if (!*budget) {
+        return NULL;
+    }
+    (*budget)--;
+
+    return malloc(size);
+}
+
+static void budget_free(void *ptr, size_t size, void *ctx)
+{
+    free(ptr);
+}
+
+static void *producer(void *arg)
+{
+    list_t *q = list_create_with_allocator(&list_allocator_thread_local);
+    void *val = NULL;
+    long total = 0;
+    int r;
+    int i;
+
+    if (q == NULL) {
+        return (void *)-1L;
+    }
+
+    for (r = 0; r < 100; r++) {
+        for (i = 0; i < FILL_COUNT; i++) {
+            list_add_last(q, (void *)(long)i);
+        }
+        while (list_pop_first(q, &val) == LIST_OK) {
+            total += (long)val;
+        }
+    }
+
+    list_destroy(q);
+
+    return (void *)total;
+}
+
 
 /*
 ** Set Up / Tear Down
@@ -48,7 +181,9 @@ void setUp(void)
 
 void tearDown(void)
 {
-    list_destroy(l);
+    if (l != NULL) {
+        list_destroy(l);
+    }
 }
 
 
@@ -346,3 +481,878 @@ void test_list_merge(void)
     TEST_ASSERT_EQUAL_INT(6, list_find_pos(l, 6));
 }
 
+
+void test_list_create_ring(void)
+{
+    l = list_create_ring(4, false);
+
+    TEST_ASSERT_NOT_NULL(l);
+    TEST_ASSERT_EQUAL_INT(LIST_RING, l->type);
+    TEST_ASSERT_EQUAL_INT(0, l->size);
+    TEST_ASSERT_EQUAL_INT(4, l->ring.capacity);
+    TEST_ASSERT_TRUE(list_is_empty(l));
+    TEST_ASSERT_FALSE(list_is_full(l));
+}
+
+void test_list_ring_fifo(void)
+{
+    int i;
+
+    l = list_create_ring(4, false);
+
+    fill(l, FILL_COUNT);
+
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT, l->size);
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT - 1, list_last(l));
+
+    for (i = 0; i < FILL_COUNT; i++) {
+        TEST_ASSERT_EQUAL_INT(i, list_first(l));
+        TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove_pos(l, 0));
+    }
+
+    TEST_ASSERT_TRUE(list_is_empty(l));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_EMPTY, list_remove_pos(l, 0));
+}
+
+void test_list_pop(void)
+{
+    l = list_create();
+
+    check_pop(l);
+}
+
+void test_list_ring_pop(void)
+{
+    l = list_create_ring(3, true);
+
+    check_pop(l);
+}
+
+void test_list_ring_add_first_wraps(void)
+{
+    l = list_create_ring(4, false);
+
+    list_add_last(l, 1);
+    list_add_first(l, 0);
+    list_add_last(l, 2);
+    list_add_first(l, -1);
+    list_add_last(l, 3);
+
+    TEST_ASSERT_EQUAL_INT(5, l->size);
+    TEST_ASSERT_EQUAL_INT(-1, list_find_pos(l, 0));
+    TEST_ASSERT_EQUAL_INT(0, list_find_pos(l, 1));
+    TEST_ASSERT_EQUAL_INT(1, list_find_pos(l, 2));
+    TEST_ASSERT_EQUAL_INT(2, list_find_pos(l, 3));
+    TEST_ASSERT_EQUAL_INT(3, list_find_pos(l, 4));
+}
+
+void test_list_ring_bounded(void)
+{
+    l = list_create_ring(3, true);
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_add_last(l, 0));
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_add_last(l, 1));
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_add_first(l, 2));
+
+    TEST_ASSERT_TRUE(list_is_full(l));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_FULL, list_add_last(l, 3));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_FULL, list_add_first(l, 3));
+    TEST_ASSERT_EQUAL_INT(3, l->size);
+
+    list_remove_pos(l, 0);
+
+    TEST_ASSERT_FALSE(list_is_full(l));
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_add_last(l, 3));
+    TEST_ASSERT_EQUAL_INT(3, list_last(l));
+}
+
+void test_list_ring_remove(void)
+{
+    l = list_create_ring(4, false);
+
+    fill(l, FILL_COUNT);
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove(l, 2));
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove(l, 8));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOT_FOUND, list_remove(l, 42));
+
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT - 2, l->size);
+    TEST_ASSERT_EQUAL_INT(-1, list_find(l, 2));
+    TEST_ASSERT_EQUAL_INT(-1, list_find(l, 8));
+    TEST_ASSERT_EQUAL_INT(2, list_find(l, 3));
+    TEST_ASSERT_EQUAL_INT(7, list_find(l, 9));
+}
+
+void test_list_ring_sort(void)
+{
+    l = list_create_ring(7, true);
+
+    list_add_last(l, 6);
+    list_add_last(l, 3);
+    list_add_last(l, 0);
+    list_add_last(l, 1);
+    list_add_first(l, 2);
+    list_add_last(l, 5);
+    list_add_last(l, 4);
+
+    list_sort(l);
+
+    TEST_ASSERT_EQUAL_INT(0, list_find_pos(l, 0));
+    TEST_ASSERT_EQUAL_INT(1, list_find_pos(l, 1));
+    TEST_ASSERT_EQUAL_INT(2, list_find_pos(l, 2));
+    TEST_ASSERT_EQUAL_INT(3, list_find_pos(l, 3));
+    TEST_ASSERT_EQUAL_INT(4, list_find_pos(l, 4));
+    TEST_ASSERT_EQUAL_INT(5, list_find_pos(l, 5));
+    TEST_ASSERT_EQUAL_INT(6, list_find_pos(l, 6));
+}
+
+void test_list_create_compact(void)
+{
+    l = list_create_compact();
+
+    TEST_ASSERT_NOT_NULL(l);
+    TEST_ASSERT_EQUAL_INT(LIST_COMPACT, l->type);
+    TEST_ASSERT_EQUAL_INT(0, l->size);
+    TEST_ASSERT_EQUAL_UINT32(LIST_NIL, l->pool.head);
+    TEST_ASSERT_EQUAL_UINT32(LIST_NIL, l->pool.tail);
+    TEST_ASSERT_EQUAL_INT(16, sizeof(cnode_t));
+}
+
+void test_list_compact_add_and_traverse(void)
+{
+    uint32_t i;
+    int val = FILL_COUNT - 1;
+
+    l = list_create_compact();
+
+    fill(l, FILL_COUNT);
+    list_add_first(l, -1);
+
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT + 1, l->size);
+    TEST_ASSERT_EQUAL_INT(-1, list_first(l));
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT - 1, list_last(l));
+    TEST_ASSERT_EQUAL_INT(6, list_find(l, 5));
+    TEST_ASSERT_EQUAL_INT(5, list_find_pos(l, 6));
+    TEST_ASSERT_EQUAL_INT(9, list_find_pos(l, 10));
+
+    for (i = l->pool.tail; i != LIST_NIL;
+         i = LIST_POOL_NODE(&l->pool, i)->prev) {
+        TEST_ASSERT_EQUAL_INT(val--, LIST_POOL_NODE(&l->pool, i)->val);
+    }
+    TEST_ASSERT_EQUAL_INT(-2, val);
+}
+
+void test_list_compact_remove_reuses_nodes(void)
+{
+    uint32_t capacity;
+
+    l = list_create_compact();
+
+    fill(l, FILL_COUNT);
+    capacity = l->pool.capacity;
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove(l, 5));
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove_pos(l, 0));
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove_pos(l, l->size - 1));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOT_FOUND, list_remove(l, 5));
+
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT - 3, l->size);
+    TEST_ASSERT_EQUAL_INT(1, list_first(l));
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT - 2, list_last(l));
+    TEST_ASSERT_EQUAL_INT(-1, list_find(l, 5));
+
+    fill(l, 3);
+
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT, l->size);
+    TEST_ASSERT_EQUAL_UINT32(capacity, l->pool.capacity);
+    TEST_ASSERT_EQUAL_UINT32(FILL_COUNT, l->pool.used);
+}
+
+void test_list_compact_pop(void)
+{
+    l = list_create_compact();
+
+    check_pop(l);
+}
+
+void test_list_compact_sort(void)
+{
+    l = list_create_compact();
+
+    list_add_last(l, 6);
+    list_add_last(l, 3);
+    list_add_last(l, 0);
+    list_add_last(l, 1);
+    list_add_first(l, 2);
+    list_add_last(l, 5);
+    list_add_last(l, 4);
+
+    list_sort(l);
+
+    TEST_ASSERT_EQUAL_INT(0, list_find_pos(l, 0));
+    TEST_ASSERT_EQUAL_INT(1, list_find_pos(l, 1));
+    TEST_ASSERT_EQUAL_INT(2, list_find_pos(l, 2));
+    TEST_ASSERT_EQUAL_INT(3, list_find_pos(l, 3));
+    TEST_ASSERT_EQUAL_INT(4, list_find_pos(l, 4));
+    TEST_ASSERT_EQUAL_INT(5, list_find_pos(l, 5));
+    TEST_ASSERT_EQUAL_INT(6, list_find_pos(l, 6));
+}
+
+void test_list_memory_usage(void)
+{
+    list_t *compact = list_create_compact();
+
+    l = list_create();
+
+    fill(l, FILL_COUNT);
+    fill(compact, FILL_COUNT);
+
+    TEST_ASSERT_EQUAL_INT(3 * sizeof(void *), sizeof(element_t));
+    TEST_ASSERT_EQUAL_INT(sizeof(list_t) + FILL_COUNT * sizeof(element_t),
+                          list_memory_usage(l));
+    TEST_ASSERT_EQUAL_INT(sizeof(list_t) + 16 * sizeof(cnode_t) +
+                          sizeof(cnode_t *), list_memory_usage(compact));
+
+    list_destroy(compact);
+}
+
+void test_list_compact_blocks(void)
+{
+    uint32_t count = 2 * LIST_POOL_BLOCK_SIZE + 1;
+    uint32_t i;
+
+    l = list_create_compact();
+
+    for (i = 0; i < count; i++) {
+        list_add_first(l, (void *)(intptr_t)i);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(3, l->pool.nblocks);
+    TEST_ASSERT_EQUAL_UINT32(3 * LIST_POOL_BLOCK_SIZE, l->pool.capacity);
+    TEST_ASSERT_EQUAL_INT(sizeof(list_t) +
+                          3 * LIST_POOL_BLOCK_SIZE * sizeof(cnode_t) +
+                          4 * sizeof(cnode_t *), list_memory_usage(l));
+    TEST_ASSERT_EQUAL_INT(count - 1, list_first(l));
+    TEST_ASSERT_EQUAL_INT(0, list_last(l));
+    TEST_ASSERT_EQUAL_INT(LIST_POOL_BLOCK_SIZE,
+                          list_find_pos(l, count - 1 - LIST_POOL_BLOCK_SIZE));
+
+    list_remove(l, (void *)(intptr_t)LIST_POOL_BLOCK_SIZE);
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_defragment(l));
+
+    TEST_ASSERT_TRUE(l->pool.ordered);
+    TEST_ASSERT_EQUAL_UINT32(2, l->pool.nblocks);
+    for (i = 0; i < count - 1; i++) {
+        TEST_ASSERT_EQUAL_INT(list_find_pos(l, i),
+                              LIST_POOL_NODE(&l->pool, i)->val);
+    }
+}
+
+void test_list_remove_element(void)
+{
+    element_t *e;
+
+    l = list_create();
+
+    fill(l, 5);
+    e = l->head->next->next;
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove_element(l, e));
+    TEST_ASSERT_EQUAL_INT(4, l->size);
+    TEST_ASSERT_EQUAL_INT(-1, list_find(l, 2));
+}
+
+void test_list_add_element(void)
+{
+    element_t *first;
+    element_t *last;
+    list_t *ring = list_create_ring(0, false);
+
+    l = list_create();
+
+    fill(l, 3);
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_add_last_element(l, 7, &last));
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_add_first_element(l, 8, &first));
+    TEST_ASSERT_EQUAL(l->tail, last);
+    TEST_ASSERT_EQUAL(l->head, first);
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove_element(l, last));
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove_element(l, first));
+    TEST_ASSERT_EQUAL_INT(0, list_first(l));
+    TEST_ASSERT_EQUAL_INT(2, list_last(l));
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_add_last_element(ring, 7, &last));
+    TEST_ASSERT_NULL(last);
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOT_FOUND, list_remove_element(ring, last));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOT_FOUND, list_remove_element(l, NULL));
+    TEST_ASSERT_EQUAL_INT(1, ring->size);
+    TEST_ASSERT_EQUAL_INT(3, l->size);
+
+    list_destroy(ring);
+}
+
+void test_list_lazy_remove_leaves_tombstones(void)
+{
+    element_t *first;
+    element_t *last;
+    int i;
+
+    l = list_create();
+    list_set_lazy(l, true, 0);
+
+    list_add_last_element(l, 0, &first);
+    for (i = 1; i < FILL_COUNT - 1; i++) {
+        list_add_last(l, i);
+    }
+    list_add_last_element(l, FILL_COUNT - 1, &last);
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove_element(l, first));
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove_element(l, last));
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove(l, 5));
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove_pos(l, 0));
+
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT - 4, l->size);
+    TEST_ASSERT_EQUAL_INT(4, l->dead);
+    TEST_ASSERT_EQUAL(first, l->head);
+    TEST_ASSERT_EQUAL(last, l->tail);
+
+    TEST_ASSERT_EQUAL_INT(2, list_first(l));
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT - 2, list_last(l));
+    TEST_ASSERT_EQUAL_INT(-1, list_find(l, 5));
+    TEST_ASSERT_EQUAL_INT(3, list_find(l, 6));
+    TEST_ASSERT_EQUAL_INT(6, list_find_pos(l, 3));
+}
+
+void test_list_compact(void)
+{
+    l = list_create();
+    list_set_lazy(l, true, 0);
+
+    fill(l, FILL_COUNT);
+    list_remove(l, 0);
+    list_remove(l, 5);
+    list_remove(l, FILL_COUNT - 1);
+
+    TEST_ASSERT_EQUAL_INT(3, list_compact(l));
+    TEST_ASSERT_EQUAL_INT(0, l->dead);
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT - 3, l->size);
+    TEST_ASSERT_EQUAL_INT(1, l->head->val);
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT - 2, l->tail->val);
+    TEST_ASSERT_EQUAL_INT(4, list_find(l, 6));
+
+    list_add_first(l, 0);
+    TEST_ASSERT_EQUAL_INT(0, list_first(l));
+}
+
+void test_list_compact_threshold(void)
+{
+    l = list_create();
+    list_set_lazy(l, true, 3);
+
+    fill(l, FILL_COUNT);
+    list_remove(l, 1);
+    list_remove(l, 2);
+
+    TEST_ASSERT_EQUAL_INT(2, l->dead);
+
+    list_remove(l, 3);
+
+    TEST_ASSERT_EQUAL_INT(0, l->dead);
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT - 3, l->size);
+}
+
+void test_list_lazy_all_removed(void)
+{
+    l = list_create();
+    list_set_lazy(l, true, 0);
+
+    fill(l, 3);
+    list_remove_pos(l, 0);
+    list_remove_pos(l, 0);
+    list_remove_pos(l, 0);
+
+    TEST_ASSERT_TRUE(list_is_empty(l));
+    TEST_ASSERT_EQUAL_INT(-1, list_first(l));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_EMPTY, list_remove_pos(l, 0));
+
+    list_add_last(l, 7);
+
+    TEST_ASSERT_EQUAL_INT(7, list_first(l));
+    TEST_ASSERT_EQUAL_INT(7, list_last(l));
+
+    list_set_lazy(l, false, 0);
+
+    TEST_ASSERT_EQUAL_INT(0, l->dead);
+    TEST_ASSERT_EQUAL(l->head, l->tail);
+}
+
+void test_list_parallel_small(void)
+{
+    l = list_create();
+
+    check_parallel(l, FILL_COUNT);
+
+    TEST_ASSERT_EQUAL_INT(1, l->nparts);
+}
+
+void test_list_parallel_linked(void)
+{
+    l = list_create();
+
+    check_parallel(l, 3 * LIST_PARALLEL_MIN_SIZE + 1);
+
+    TEST_ASSERT_EQUAL_INT(4, l->nparts);
+}
+
+void test_list_parallel_lazy(void)
+{
+    int i;
+
+    l = list_create();
+    list_set_lazy(l, true, 0);
+
+    fill(l, LIST_PARALLEL_MIN_SIZE);
+    for (i = 0; i < LIST_PARALLEL_MIN_SIZE; i++) {
+        list_remove(l, i);
+    }
+    TEST_ASSERT_EQUAL_INT(LIST_PARALLEL_MIN_SIZE, l->dead);
+
+    check_parallel(l, 2 * LIST_PARALLEL_MIN_SIZE);
+}
+
+void test_list_parallel_ring(void)
+{
+    l = list_create_ring(0, false);
+
+    check_parallel(l, 3 * LIST_PARALLEL_MIN_SIZE + 1);
+}
+
+void test_list_parallel_compact(void)
+{
+    l = list_create_compact();
+
+    check_parallel(l, 3 * LIST_PARALLEL_MIN_SIZE + 1);
+}
+
+void test_list_parallel_parts_cached(void)
+{
+    struct cursor *parts;
+
+    l = list_create();
+
+    fill(l, 2 * LIST_PARALLEL_MIN_SIZE);
+    list_set_threads(l, 2);
+
+    list_reduce(l, sum, 0, NULL);
+    TEST_ASSERT_EQUAL_INT(2, l->nparts);
+    parts = l->parts;
+
+    list_map(l, double_val, NULL);
+    TEST_ASSERT_EQUAL_INT(2, l->nparts);
+    TEST_ASSERT_EQUAL(parts, l->parts);
+
+    list_add_last(l, 1);
+    list_add_first(l, 2);
+    TEST_ASSERT_EQUAL_INT(2, l->nparts);
+    TEST_ASSERT_EQUAL(parts, l->parts);
+    TEST_ASSERT_EQUAL_INT64(2L * LIST_PARALLEL_MIN_SIZE *
+                            (2 * LIST_PARALLEL_MIN_SIZE - 1) + 3,
+                            (long)list_reduce(l, sum, 0, NULL));
+    TEST_ASSERT_EQUAL(parts, l->parts);
+
+    list_remove_pos(l, 0);
+    TEST_ASSERT_EQUAL_INT(0, l->nparts);
+}
+
+void test_list_parallel_parts_rebalanced(void)
+{
+    long expected;
+    int i;
+
+    l = list_create();
+    list_set_threads(l, 4);
+
+    fill(l, LIST_PARALLEL_MIN_SIZE);
+    list_reduce(l, sum, 0, NULL);
+
+    for (i = 0; i < 3 * LIST_PARALLEL_MIN_SIZE; i++) {
+        list_add_first(l, 1);
+        list_add_last(l, 2);
+    }
+    expected = (long)LIST_PARALLEL_MIN_SIZE * (LIST_PARALLEL_MIN_SIZE - 1) / 2 +
+               9L * LIST_PARALLEL_MIN_SIZE;
+
+    TEST_ASSERT_EQUAL_INT64(expected, (long)list_reduce(l, sum, 0, NULL));
+    TEST_ASSERT_EQUAL_INT(4, l->nparts);
+}
+
+void test_list_parallel_concurrent_readers(void)
+{
+    pthread_t threads[4];
+    void *res;
+    long expected = (long)4 * LIST_PARALLEL_MIN_SIZE *
+                    (4 * LIST_PARALLEL_MIN_SIZE - 1) / 2;
+    int k;
+
+    l = list_create();
+
+    fill(l, 4 * LIST_PARALLEL_MIN_SIZE);
+    list_set_threads(l, 3);
+
+    for (k = 0; k < 4; k++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[k], NULL,
+                                                reduce_worker, l));
+    }
+    for (k = 0; k < 4; k++) {
+        pthread_join(threads[k], &res);
+        TEST_ASSERT_EQUAL_INT64(expected, (long)res);
+    }
+}
+
+void test_list_sort_reversed(void)
+{
+    int i;
+
+    l = list_create();
+    list_set_lazy(l, true, 0);
+
+    for (i = 0; i < 1000; i++) {
+        list_add_first(l, i);
+    }
+    list_remove(l, 500);
+
+    list_sort(l);
+
+    TEST_ASSERT_EQUAL_INT(999, l->size);
+    TEST_ASSERT_EQUAL_INT(0, list_first(l));
+    TEST_ASSERT_EQUAL_INT(499, list_find_pos(l, 499));
+    TEST_ASSERT_EQUAL_INT(501, list_find_pos(l, 500));
+    TEST_ASSERT_EQUAL_INT(999, list_last(l));
+}
+
+void test_list_sort_handles(void)
+{
+    element_t *five;
+    element_t *one;
+
+    l = list_create();
+    list_set_lazy(l, true, 0);
+
+    list_add_last_element(l, 5, &five);
+    list_add_last_element(l, 1, &one);
+    list_add_last(l, 4);
+    list_add_last(l, 3);
+    list_remove(l, 4);
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_sort(l));
+
+    TEST_ASSERT_EQUAL_INT(5, five->val);
+    TEST_ASSERT_EQUAL_INT(1, one->val);
+    TEST_ASSERT_EQUAL_INT(1, list_first(l));
+    TEST_ASSERT_EQUAL_INT(5, list_last(l));
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_remove_element(l, five));
+    TEST_ASSERT_EQUAL_INT(2, list_compact(l));
+    TEST_ASSERT_EQUAL_INT(2, l->size);
+    TEST_ASSERT_EQUAL_INT(1, list_first(l));
+    TEST_ASSERT_EQUAL_INT(3, list_last(l));
+}
+
+void test_list_defragment(void)
+{
+    element_t *e;
+    int i;
+
+    l = list_create();
+    list_set_lazy(l, true, 0);
+
+    for (i = 0; i < FILL_COUNT; i++) {
+        if (i & 1) {
+            list_add_first(l, i);
+        } else {
+            list_add_last(l, i);
+        }
+    }
+    list_remove(l, 3);
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_defragment(l));
+
+    TEST_ASSERT_EQUAL_INT(0, l->dead);
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT - 1, l->size);
+    TEST_ASSERT_EQUAL(l->slab.nodes, l->head);
+    TEST_ASSERT_EQUAL(&l->slab.nodes[FILL_COUNT - 2], l->tail);
+    TEST_ASSERT_EQUAL_INT(9, list_first(l));
+    TEST_ASSERT_EQUAL_INT(10, list_last(l));
+    TEST_ASSERT_EQUAL_INT(-1, list_find(l, 3));
+
+    for (e = l->head; e->next != NULL; e = e->next) {
+        TEST_ASSERT_EQUAL(e + 1, e->next);
+        TEST_ASSERT_EQUAL(e, LIST_PREV(e->next));
+    }
+    TEST_ASSERT_EQUAL(l->tail, e);
+}
+
+void test_list_defragment_reuses_slab(void)
+{
+    size_t bytes;
+
+    l = list_create();
+
+    fill(l, FILL_COUNT);
+    list_defragment(l);
+    bytes = list_memory_usage(l);
+
+    list_remove_pos(l, 4);
+    list_remove_pos(l, 0);
+
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT - 2, l->slab.used);
+    TEST_ASSERT_EQUAL_INT(bytes, list_memory_usage(l));
+
+    list_add_last(l, 42);
+    list_add_first(l, 43);
+
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT, l->slab.used);
+    TEST_ASSERT_NULL(l->slab.free);
+    TEST_ASSERT_TRUE(l->head->prev & LIST_ELEMENT_POOLED);
+    TEST_ASSERT_TRUE(l->tail->prev & LIST_ELEMENT_POOLED);
+    TEST_ASSERT_EQUAL_INT(bytes, list_memory_usage(l));
+
+    list_add_last(l, 44);
+
+    TEST_ASSERT_FALSE(l->tail->prev & LIST_ELEMENT_POOLED);
+    TEST_ASSERT_EQUAL_INT(bytes + sizeof(element_t), list_memory_usage(l));
+
+    list_defragment(l);
+
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT + 1, l->slab.size);
+    TEST_ASSERT_EQUAL_INT(43, list_first(l));
+    TEST_ASSERT_EQUAL_INT(44, list_last(l));
+}
+
+void test_list_defragment_compact(void)
+{
+    int i;
+
+    l = list_create_compact();
+
+    for (i = 0; i < FILL_COUNT; i++) {
+        list_add_first(l, i);
+    }
+    list_remove(l, 5);
+
+    TEST_ASSERT_FALSE(l->pool.ordered);
+
+    list_defragment(l);
+
+    TEST_ASSERT_TRUE(l->pool.ordered);
+    TEST_ASSERT_EQUAL_UINT32(0, l->pool.head);
+    TEST_ASSERT_EQUAL_UINT32(FILL_COUNT - 2, l->pool.tail);
+    TEST_ASSERT_EQUAL_UINT32(FILL_COUNT - 1, l->pool.used);
+    TEST_ASSERT_EQUAL_UINT32(LIST_NIL, l->pool.free);
+
+    for (i = 0; i < FILL_COUNT - 1; i++) {
+        TEST_ASSERT_EQUAL_INT(list_find_pos(l, i),
+                              LIST_POOL_NODE(&l->pool, i)->val);
+    }
+    TEST_ASSERT_EQUAL_INT(10, list_first(l));
+    TEST_ASSERT_EQUAL_INT(0, list_last(l));
+
+    list_add_last(l, 11);
+    TEST_ASSERT_TRUE(l->pool.ordered);
+    list_remove(l, 11);
+    list_add_last(l, 12);
+    TEST_ASSERT_FALSE(l->pool.ordered);
+}
+
+void test_list_set_allocator(void)
+{
+    int budget = 3;
+    list_allocator_t a = { budget_alloc, budget_free, &budget };
+
+    l = list_create();
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_set_allocator(l, &a));
+
+    fill(l, 3);
+    TEST_ASSERT_EQUAL_INT(0, budget);
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOMEM, list_add_last(l, 3));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOMEM, list_add_first(l, 3));
+    TEST_ASSERT_EQUAL_INT(3, l->size);
+    TEST_ASSERT_EQUAL_INT(2, list_last(l));
+
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOT_EMPTY,
+                          list_set_allocator(l, &list_allocator_default));
+
+    budget = 1;
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_add_last(l, 3));
+    TEST_ASSERT_EQUAL_INT(4, l->size);
+}
+
+void test_list_set_allocator_nomem(void)
+{
+    int budget = 0;
+    list_allocator_t a = { budget_alloc, budget_free, &budget };
+    void **buf;
+
+    l = list_create_ring(4, false);
+    buf = l->ring.buf;
+
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOMEM, list_set_allocator(l, &a));
+    TEST_ASSERT_EQUAL(buf, l->ring.buf);
+    TEST_ASSERT_EQUAL_INT(4, l->ring.capacity);
+
+    fill(l, 5);
+    TEST_ASSERT_EQUAL_INT(4, list_last(l));
+}
+
+void test_list_create_with_allocator(void)
+{
+    int budget = 1;
+    list_allocator_t a = { budget_alloc, budget_free, &budget };
+    list_t *odd;
+
+    TEST_ASSERT_NULL(list_create_ring_with_allocator(4, false, &a));
+    TEST_ASSERT_EQUAL_INT(0, budget);
+    TEST_ASSERT_NULL(list_create_compact_with_allocator(&a));
+
+    budget = 2;
+    l = list_create_ring_with_allocator(4, false, &a);
+    TEST_ASSERT_NOT_NULL(l);
+    TEST_ASSERT_EQUAL_INT(0, budget);
+    list_destroy(l);
+
+    budget = 1 + FILL_COUNT;
+    l = list_create_with_allocator(&a);
+    fill(l, FILL_COUNT);
+    TEST_ASSERT_EQUAL_INT(0, budget);
+    TEST_ASSERT_NULL(list_filter(l, is_odd, NULL));
+
+    budget = 2 + 2 + FILL_COUNT / 2;
+    odd = list_filter(l, is_odd, NULL);
+    TEST_ASSERT_NOT_NULL(odd);
+    TEST_ASSERT_EQUAL_INT(FILL_COUNT / 2, odd->size);
+    TEST_ASSERT_EQUAL_INT(0, budget);
+
+    list_destroy(odd);
+}
+
+void test_list_ring_nomem(void)
+{
+    int budget = 2;
+    list_allocator_t a = { budget_alloc, budget_free, &budget };
+
+    l = list_create_ring_with_allocator(2, false, &a);
+
+    fill(l, 2);
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOMEM, list_add_last(l, 2));
+    TEST_ASSERT_EQUAL_INT(2, l->ring.capacity);
+    TEST_ASSERT_EQUAL_INT(1, list_last(l));
+}
+
+void test_list_compact_nomem(void)
+{
+    int budget = 3;
+    list_allocator_t a = { budget_alloc, budget_free, &budget };
+
+    l = list_create_compact_with_allocator(&a);
+
+    fill(l, LIST_POOL_DEFAULT_CAPACITY);
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOMEM, list_add_first(l, -1));
+    TEST_ASSERT_EQUAL_INT(LIST_POOL_DEFAULT_CAPACITY, l->size);
+    TEST_ASSERT_EQUAL_INT(0, list_first(l));
+
+    budget = 1;
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_add_first(l, -1));
+    TEST_ASSERT_EQUAL_INT(-1, list_first(l));
+}
+
+void test_list_sort_and_defragment_nomem(void)
+{
+    int budget = 4;
+    list_allocator_t a = { budget_alloc, budget_free, &budget };
+
+    l = list_create();
+    list_set_allocator(l, &a);
+
+    list_add_last(l, 3);
+    list_add_last(l, 1);
+    list_add_last(l, 2);
+    list_add_last(l, 0);
+
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOMEM, list_sort(l));
+    TEST_ASSERT_EQUAL_INT(3, list_first(l));
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOMEM, list_defragment(l));
+    TEST_ASSERT_EQUAL_INT(3, list_first(l));
+
+    budget = 1;
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_sort(l));
+    TEST_ASSERT_EQUAL_INT(0, list_find_pos(l, 0));
+    TEST_ASSERT_EQUAL_INT(3, list_find_pos(l, 3));
+
+    budget = 1;
+    TEST_ASSERT_EQUAL_INT(LIST_OK, list_defragment(l));
+    TEST_ASSERT_EQUAL_INT(0, list_first(l));
+    TEST_ASSERT_EQUAL_INT(3, list_last(l));
+}
+
+void test_list_merge_nomem(void)
+{
+    int budget = 2;
+    list_allocator_t a = { budget_alloc, budget_free, &budget };
+    list_t *left  = list_create();
+    list_t *right = list_create();
+
+    l = list_create();
+    list_set_allocator(l, &a);
+
+    list_add_last(left,  0);
+    list_add_last(left,  2);
+    list_add_last(right, 1);
+    list_add_last(right, 3);
+
+    TEST_ASSERT_EQUAL_INT(LIST_ERR_NOMEM, list_merge(left, right, l));
+    TEST_ASSERT_EQUAL_INT(2, l->size);
+    TEST_ASSERT_EQUAL_INT(2, list_first(left));
+    TEST_ASSERT_EQUAL_INT(3, list_first(right));
+
+    list_destroy(left);
+    list_destroy(right);
+}
+
+void test_list_thread_local_allocator(void)
+{
+    element_t *e;
+
+    l = list_create();
+
+    TEST_ASSERT_EQUAL_INT(LIST_OK,
+                          list_set_allocator(l, &list_allocator_thread_local));
+
+    list_add_last(l, 1);
+    e = l->tail;
+    list_remove_pos(l, 0);
+
+    list_add_last(l, 2);
+    TEST_ASSERT_EQUAL(e, l->tail);
+
+    list_destroy(l);
+    l = NULL;
+    list_thread_cache_flush();
+}
+
+void test_list_thread_local_allocator_producers(void)
+{
+    pthread_t threads[4];
+    void *total;
+    int k;
+
+    for (k = 0; k < 4; k++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[k], NULL,
+                                                producer, NULL));
+    }
+    for (k = 0; k < 4; k++) {
+        pthread_join(threads[k], &total);
+        TEST_ASSERT_EQUAL_INT64(100L * FILL_COUNT * (FILL_COUNT - 1) / 2,
+                                (long)total);
+    }
+}